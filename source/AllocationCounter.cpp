@@ -0,0 +1,35 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<uint64_t> g_AllocationCount{};
+}
+
+uint64_t dae::AllocationCounter::GetCount()
+{
+	return g_AllocationCount.load(std::memory_order_relaxed);
+}
+
+// Replacing these is enough, the array and nothrow versions forward to them
+void* operator new(std::size_t size)
+{
+	g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	// malloc(0) is allowed to return nullptr, new never is
+	if (void* pMemory{ std::malloc(size ? size : 1) }) return pMemory;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* pMemory) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete(void* pMemory, std::size_t) noexcept
+{
+	std::free(pMemory);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+namespace dae
+{
+	// Counts every call to the global operator new, so it can be checked that a frame doesn't touch the heap
+	namespace AllocationCounter
+	{
+		uint64_t GetCount();
+	}
+}
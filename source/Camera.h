@@ -1,5 +1,6 @@
 #pragma once
 #include <cassert>
+#include <cstdint>
 #include <SDL_keyboard.h>
 #include <SDL_mouse.h>
 
@@ -41,9 +42,40 @@ namespace dae
 		float baseMovementSpeed{ 15 };
 		float speedMultiplier{ 4 };
 
-		inline bool ShouldVertexBeClipped(const Vector4& v) const
+		// Triangles within the guard band are rasterized as is, the boundingbox takes care of the screen edges
+		// Only triangles crossing the near/far plane or leaving the guard band are clipped
+		// (In NDC units, 2 means one screen size beyond every side)
+		float guardBand{ 2.f };
+
+		enum ClipPlane : uint8_t
+		{
+			ClipLeft = 1 << 0,
+			ClipRight = 1 << 1,
+			ClipBottom = 1 << 2,
+			ClipTop = 1 << 3,
+			ClipNear = 1 << 4,
+			ClipFar = 1 << 5,
+			ClipPlaneCount = 6
+		};
+
+		// Signed distance of a clip space position to a clip plane, negative is outside
+		// Float is float or SimdFloat, so the vertex transform and the clipper test the same planes
+		template<typename Float>
+		static Float GetClipDistance(const Float& x, const Float& y, const Float& z, const Float& w, const Float& guardBand, int planeIdx)
+		{
+			switch (planeIdx)
+			{
+			case 0: return x + guardBand * w;
+			case 1: return guardBand * w - x;
+			case 2: return y + guardBand * w;
+			case 3: return guardBand * w - y;
+			case 4: return z;
+			default: return w - z;
+			}
+		}
+		inline float GetClipDistance(const Vector4& v, int planeIdx) const
 		{
-			return v.x < -1.f || v.x > 1.f || v.y < -1.f || v.y > 1.f;
+			return GetClipDistance(v.x, v.y, v.z, v.w, guardBand, planeIdx);
 		}
 
 		void Initialize(float _fovAngle = 90.f, Vector3 _origin = {0.f,0.f,0.f}, float _aspectRatio = 1.f)
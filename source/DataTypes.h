@@ -10,18 +10,62 @@ namespace dae
 		ColorRGB color{ colors::White };
 		Vector2 uv{}; //W3
 		Vector3 normal{}; //W4
-		Vector3 tangent{}; //W4
 		Vector3 viewDirection{}; //W4
 	};
 
 	struct Vertex_Out
 	{
 		Vector4 position{};
-		ColorRGB color{ colors::White };
 		Vector2 uv{};
 		Vector3 normal{};
 		Vector3 tangent{};
+		// -1 where the bitangent is -Cross(normal, tangent)
+		float bitangentSign{ 1.f };
 		Vector3 viewDirection{};
+		// Change of uv over one pixel to the right and one pixel down, picks the mip level of the textures
+		Vector2 uvDdx{};
+		Vector2 uvDdy{};
+	};
+
+	// Structure of arrays, every component has its own array
+	// so SIMD code can load the same component of consecutive vertices at once
+	struct Vector2Stream
+	{
+		std::vector<float> x{};
+		std::vector<float> y{};
+
+		size_t GetSize() const { return x.size(); }
+		void Resize(size_t size) { x.resize(size); y.resize(size); }
+		Vector2 Get(size_t idx) const { return { x[idx], y[idx] }; }
+		void Set(size_t idx, const Vector2& v) { x[idx] = v.x; y[idx] = v.y; }
+		void PushBack(const Vector2& v) { x.push_back(v.x); y.push_back(v.y); }
+	};
+
+	struct Vector3Stream
+	{
+		std::vector<float> x{};
+		std::vector<float> y{};
+		std::vector<float> z{};
+
+		size_t GetSize() const { return x.size(); }
+		void Resize(size_t size) { x.resize(size); y.resize(size); z.resize(size); }
+		Vector3 Get(size_t idx) const { return { x[idx], y[idx], z[idx] }; }
+		void Set(size_t idx, const Vector3& v) { x[idx] = v.x; y[idx] = v.y; z[idx] = v.z; }
+		void PushBack(const Vector3& v) { x.push_back(v.x); y.push_back(v.y); z.push_back(v.z); }
+	};
+
+	struct Vector4Stream
+	{
+		std::vector<float> x{};
+		std::vector<float> y{};
+		std::vector<float> z{};
+		std::vector<float> w{};
+
+		size_t GetSize() const { return x.size(); }
+		void Resize(size_t size) { x.resize(size); y.resize(size); z.resize(size); w.resize(size); }
+		Vector4 Get(size_t idx) const { return { x[idx], y[idx], z[idx], w[idx] }; }
+		void Set(size_t idx, const Vector4& v) { x[idx] = v.x; y[idx] = v.y; z[idx] = v.z; w[idx] = v.w; }
+		void PushBack(const Vector4& v) { x.push_back(v.x); y.push_back(v.y); z.push_back(v.z); w.push_back(v.w); }
 	};
 
 	enum class PrimitiveTopology
@@ -32,13 +76,91 @@ namespace dae
 
 	struct Mesh
 	{
-		std::vector<Vertex> vertices{};
+		// One entry per vertex in every stream
+		Vector3Stream positions{};
+		Vector3Stream normals{};
+		// Filled by MeshTangents::Generate
+		Vector3Stream tangents{};
+		std::vector<float> bitangentSigns{};
+		Vector2Stream uvs{};
 		std::vector<uint32_t> indices{};
 		PrimitiveTopology primitiveTopology{ PrimitiveTopology::TriangleList };
 
-		std::vector<Vertex_Out> vertices_out{};
+		// Post-transform streams, one entry per vertex followed by the vertices added by the clipper
+		// positions_out is the NDC position and w, meaningless for vertices outside of the clip volume
+		Vector4Stream positions_out{};
+		Vector3Stream normals_out{};
+		Vector3Stream tangents_out{};
+		Vector3Stream viewDirections_out{};
+		// uv and the bitangent sign pass through the transform as is, so only the clipper's vertices get an entry here
+		// See GetUVOut and GetBitangentSignOut
+		Vector2Stream uvs_clipped{};
+		std::vector<float> bitangentSigns_clipped{};
+		// Triangle list made by the clipper, the extra vertices are appended to the post-transform streams
+		std::vector<uint32_t> clippedIndices{};
+		// Screen position of every post-transform vertex, in the fixed point of the rasterizer
+		std::vector<Int2> vertices_raster{};
 		Matrix worldMatrix{};
 
+		inline size_t GetNrVertices() const { return positions.GetSize(); }
+
+		// Splits the vertices over the streams, the tangents are left to MeshTangents::Generate
+		inline void SetVertices(const std::vector<Vertex>& vertices)
+		{
+			positions.Resize(vertices.size());
+			normals.Resize(vertices.size());
+			uvs.Resize(vertices.size());
+			for (size_t vertIdx{ 0 }; vertIdx < vertices.size(); ++vertIdx)
+			{
+				positions.Set(vertIdx, vertices[vertIdx].position);
+				normals.Set(vertIdx, vertices[vertIdx].normal);
+				uvs.Set(vertIdx, vertices[vertIdx].uv);
+			}
+		}
+
+		// Resizes every post-transform stream except vertices_raster, size is at least GetNrVertices()
+		inline void ResizeVerticesOut(size_t size)
+		{
+			positions_out.Resize(size);
+			normals_out.Resize(size);
+			tangents_out.Resize(size);
+			viewDirections_out.Resize(size);
+			uvs_clipped.Resize(size - GetNrVertices());
+			bitangentSigns_clipped.resize(size - GetNrVertices());
+		}
+
+		inline Vector2 GetUVOut(size_t idx) const
+		{
+			return idx < GetNrVertices() ? uvs.Get(idx) : uvs_clipped.Get(idx - GetNrVertices());
+		}
+
+		inline float GetBitangentSignOut(size_t idx) const
+		{
+			return idx < GetNrVertices() ? bitangentSigns[idx] : bitangentSigns_clipped[idx - GetNrVertices()];
+		}
+
+		inline Vertex_Out GetVertexOut(size_t idx) const
+		{
+			Vertex_Out vertex{};
+			vertex.position = positions_out.Get(idx);
+			vertex.uv = GetUVOut(idx);
+			vertex.normal = normals_out.Get(idx);
+			vertex.tangent = tangents_out.Get(idx);
+			vertex.bitangentSign = GetBitangentSignOut(idx);
+			vertex.viewDirection = viewDirections_out.Get(idx);
+			return vertex;
+		}
+
+		inline void PushBackVertexOut(const Vertex_Out& vertex)
+		{
+			positions_out.PushBack(vertex.position);
+			normals_out.PushBack(vertex.normal);
+			tangents_out.PushBack(vertex.tangent);
+			viewDirections_out.PushBack(vertex.viewDirection);
+			uvs_clipped.PushBack(vertex.uv);
+			bitangentSigns_clipped.push_back(vertex.bitangentSign);
+		}
+
 		inline void RotateY(float angle)
 		{
 			worldMatrix = Matrix::CreateRotationY(angle * TO_RADIANS) * worldMatrix;
@@ -0,0 +1,34 @@
+#include "Material.h"
+#include "Texture.h"
+
+namespace dae
+{
+	Material::Material(Texture* pTexture) :
+		m_pTexture{ pTexture }
+	{
+	}
+
+	Material::~Material()
+	{
+		delete m_pTexture;
+		m_pTexture = nullptr;
+	}
+
+	Material* Material::LoadFromFiles(const std::string& diffusePath, const std::string& normalPath, const std::string& specularPath, const std::string& glossPath)
+	{
+		Texture* pTexture{ Texture::LoadLayers({ { diffusePath }, { normalPath }, { specularPath, glossPath } }) };
+		if (!pTexture)
+			return nullptr;
+		return new Material(pTexture);
+	}
+
+	MaterialSample Material::Sample(const Vector2& uv, const Vector2& uvDdx, const Vector2& uvDdy) const
+	{
+		static_assert(NrLayers <= Texture::m_MaxNrLayers, "Every map needs a layer");
+		Texture::Texel texels[NrLayers];
+		m_pTexture->Sample(uv, uvDdx, uvDdy, texels);
+
+		const ColorRGB& normal{ texels[Normal].color };
+		return { texels[Diffuse].color, Vector3{ 2.f * normal.r - 1.f, 2.f * normal.g - 1.f, 2.f * normal.b - 1.f }, texels[Specular].color, texels[Specular].alpha };
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+//Standard includes
+#include <string>
+
+//Project includes
+#include "ColorRGB.h"
+#include "Vector3.h"
+
+namespace dae
+{
+	struct Vector2;
+	class Texture;
+
+	// Every map of a material at one uv
+	struct MaterialSample
+	{
+		ColorRGB diffuse{};
+		// Tangent space, -1 to 1
+		Vector3 normal{};
+		ColorRGB specular{};
+		float gloss{};
+	};
+
+	// The maps of a material baked into a single texture, one record per pixel with a layer per map
+	// So every map is filtered with the same address computation and a pixel reads one or two cache lines for all of them
+	class Material
+	{
+	public:
+		~Material();
+
+		Material(const Material&) = delete;
+		Material(Material&&) noexcept = delete;
+		Material& operator=(const Material&) = delete;
+		Material& operator=(Material&&) noexcept = delete;
+
+		// Every image needs to be the same size, the gloss comes from the red channel of its image
+		static Material* LoadFromFiles(const std::string& diffusePath, const std::string& normalPath, const std::string& specularPath, const std::string& glossPath);
+		// Trilinear, see Texture::Sample
+		MaterialSample Sample(const Vector2& uv, const Vector2& uvDdx, const Vector2& uvDdy) const;
+
+	private:
+		enum Layer
+		{
+			Diffuse,
+			Normal,
+			// Gloss in the alpha channel
+			Specular,
+			NrLayers
+		};
+
+		explicit Material(Texture* pTexture);
+
+		Texture* m_pTexture;
+	};
+}
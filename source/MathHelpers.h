@@ -1,6 +1,8 @@
 #pragma once
 #include <cmath>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 
 namespace dae
 {
@@ -58,6 +60,36 @@ namespace dae
 		return v;
 	}
 
+	// log2 of a positive normal float, the exponent bits plus a polynomial over the mantissa
+	// Off by at most 1.5e-5
+	inline float FastLog2(float a)
+	{
+		const uint32_t bits{ std::bit_cast<uint32_t>(a) };
+		const float exponent{ static_cast<float>(static_cast<int>(bits >> 23) - 127) };
+		// Mantissa - 1, 0 to 1
+		const float m{ std::bit_cast<float>((bits & 0x7FFFFF) | 0x3F800000) - 1.f };
+		return exponent + m * (1.44196369f + m * (-0.70964755f + m * (0.41755824f + m * (-0.19623346f + m * 0.04637347f))));
+	}
+
+	// 2 to the power of a, a polynomial for the fraction and the integer part straight into the exponent bits
+	// At most 3e-6 off relatively, a is clamped to [-126, 127]
+	inline float FastExp2(float a)
+	{
+		a = std::clamp(a, -126.f, 127.f);
+		int integer{ static_cast<int>(a) };
+		if (a < integer) --integer;
+		const float f{ a - integer };
+		// 1 to 2
+		const float fraction{ 1.00000263f + f * (0.69300319f + f * (0.24144517f + f * (0.05200850f + f * 0.01353529f))) };
+		return std::bit_cast<float>(std::bit_cast<uint32_t>(fraction) + (static_cast<uint32_t>(integer) << 23));
+	}
+
+	// powf for a positive base, relative error below 2e-5 * |exponent|
+	inline float FastPow(float base, float exponent)
+	{
+		return FastExp2(exponent * FastLog2(base));
+	}
+
 	inline constexpr float Remap(float input, float min, float max)
 	{
 		// Clamp gives a value between min & max
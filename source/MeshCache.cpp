@@ -0,0 +1,168 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace dae
+{
+	namespace MeshCache
+	{
+		namespace
+		{
+			constexpr char Magic[4]{ 'D', 'A', 'E', 'M' };
+			// Bump whenever loading produces different meshes, older caches get rebuilt then
+			constexpr uint32_t Version{ 2 };
+			constexpr size_t BlobAlignment{ 16 };
+
+			struct Header
+			{
+				char magic[4];
+				uint32_t version;
+				uint64_t sourceSize;
+				int64_t sourceWriteTime;
+				uint64_t nrVertices;
+				uint64_t nrIndices;
+				uint64_t reserved;
+			};
+			static_assert(sizeof(Header) % BlobAlignment == 0, "The first blob has to start aligned");
+
+			// The vertex streams in the order they're stored in
+			template<typename MeshType>
+			auto GetVertexBlobs(MeshType& mesh)
+			{
+				return std::array{
+					&mesh.positions.x, &mesh.positions.y, &mesh.positions.z,
+					&mesh.normals.x, &mesh.normals.y, &mesh.normals.z,
+					&mesh.tangents.x, &mesh.tangents.y, &mesh.tangents.z, &mesh.bitangentSigns,
+					&mesh.uvs.x, &mesh.uvs.y };
+			}
+
+			std::string GetCachePath(const std::string& sourcePath)
+			{
+				return sourcePath + ".cache";
+			}
+
+			bool GetSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& writeTime)
+			{
+				std::error_code error{};
+				size = std::filesystem::file_size(sourcePath, error);
+				if (error) return false;
+				writeTime = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+				return !error;
+			}
+
+			size_t GetPadding(size_t size)
+			{
+				return (BlobAlignment - size % BlobAlignment) % BlobAlignment;
+			}
+		}
+
+		bool Load(const std::string& sourcePath, Mesh& mesh)
+		{
+			uint64_t sourceSize{};
+			int64_t sourceWriteTime{};
+			if (!GetSourceStamp(sourcePath, sourceSize, sourceWriteTime))
+				return false;
+
+			std::ifstream file(GetCachePath(sourcePath), std::ios::binary);
+			if (!file)
+				return false;
+
+			Header header{};
+			if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+				|| std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+				|| header.version != Version
+				|| header.sourceSize != sourceSize
+				|| header.sourceWriteTime != sourceWriteTime)
+				return false;
+
+			// A damaged count must not become a huge allocation, the blobs it describes have to fill the rest of the cache exactly
+			if (header.nrIndices % 3 != 0 || header.nrVertices > UINT32_MAX || header.nrIndices > UINT32_MAX)
+				return false;
+			const size_t vertexBlobSize{ header.nrVertices * sizeof(float) };
+			const size_t indexBlobSize{ header.nrIndices * sizeof(uint32_t) };
+			const size_t cacheSize{ sizeof(header) + GetVertexBlobs(mesh).size() * (vertexBlobSize + GetPadding(vertexBlobSize)) + indexBlobSize + GetPadding(indexBlobSize) };
+			std::error_code error{};
+			if (std::filesystem::file_size(GetCachePath(sourcePath), error) != cacheSize || error)
+				return false;
+
+			// Straight into the streams, one read per blob
+			const auto readBlob = [&](void* pData, size_t size)
+			{
+				file.read(static_cast<char*>(pData), size);
+				file.ignore(GetPadding(size));
+				return static_cast<bool>(file);
+			};
+			for (std::vector<float>* pBlob : GetVertexBlobs(mesh))
+			{
+				pBlob->resize(header.nrVertices);
+				if (!readBlob(pBlob->data(), pBlob->size() * sizeof(float)))
+					return false;
+			}
+			mesh.indices.resize(header.nrIndices);
+			if (!readBlob(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t)))
+				return false;
+
+			// A damaged cache must not make the renderer read outside of the vertices
+			if (std::any_of(mesh.indices.begin(), mesh.indices.end(), [&](uint32_t index) { return index >= header.nrVertices; }))
+				return false;
+
+			std::cout << "[MESH] " << header.nrIndices / 3 << " triangles, " << header.nrVertices << " vertices from " << GetCachePath(sourcePath) << "\n";
+			return true;
+		}
+
+		bool Save(const std::string& sourcePath, const Mesh& mesh)
+		{
+			Header header{};
+			std::memcpy(header.magic, Magic, sizeof(Magic));
+			header.version = Version;
+			header.nrVertices = mesh.GetNrVertices();
+			header.nrIndices = mesh.indices.size();
+			if (!GetSourceStamp(sourcePath, header.sourceSize, header.sourceWriteTime))
+				return false;
+
+			// Written next to the cache first and then moved over it, so a cache is never seen half written
+			const std::string cachePath{ GetCachePath(sourcePath) };
+			const std::string tempPath{ cachePath + ".tmp" };
+			std::error_code error{};
+			{
+				std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+				if (!file)
+					return false;
+
+				const auto writeBlob = [&](const void* pData, size_t size)
+				{
+					constexpr char padding[BlobAlignment]{};
+					file.write(static_cast<const char*>(pData), size);
+					file.write(padding, GetPadding(size));
+				};
+				writeBlob(&header, sizeof(header));
+				for (const std::vector<float>* pBlob : GetVertexBlobs(mesh))
+				{
+					writeBlob(pBlob->data(), pBlob->size() * sizeof(float));
+				}
+				writeBlob(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+
+				if (!file.flush())
+				{
+					file.close();
+					std::filesystem::remove(tempPath, error);
+					return false;
+				}
+			}
+
+			std::filesystem::rename(tempPath, cachePath, error);
+			if (error)
+			{
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+			return true;
+		}
+	}
+}
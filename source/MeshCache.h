@@ -0,0 +1,21 @@
+#pragma once
+
+//Standard includes
+#include <string>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	// Binary copy of a loaded mesh next to its source file (<source>.cache), so later runs skip parsing and optimizing
+	// A header followed by every vertex stream and the indices, each padded to 16 bytes
+	// The cache is only used when the size and write time of the source still match
+	namespace MeshCache
+	{
+		// Fills the vertex streams and indices of the mesh, false if there is no valid cache for the source
+		bool Load(const std::string& sourcePath, Mesh& mesh);
+		// Writes the vertex streams and indices of the mesh, false if the cache couldn't be written
+		bool Save(const std::string& sourcePath, const Mesh& mesh);
+	}
+}
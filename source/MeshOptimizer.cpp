@@ -0,0 +1,313 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+namespace dae
+{
+	namespace MeshOptimizer
+	{
+		void Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			const float acmrBefore{ GetACMR(indices, vertices.size()) };
+			const float overdrawBefore{ GetOverdraw(vertices, indices) };
+
+			std::vector<uint32_t> clusterOffsets{};
+			OptimizeVertexCache(indices, vertices.size(), clusterOffsets);
+			OptimizeOverdraw(indices, vertices, clusterOffsets);
+			OptimizeVertexFetch(vertices, indices);
+
+			std::cout << "[MESH] " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices, " << clusterOffsets.size() << " clusters\n";
+			std::cout << "[MESH] ACMR " << acmrBefore << " -> " << GetACMR(indices, vertices.size())
+				<< ", overdraw " << overdrawBefore << " -> " << GetOverdraw(vertices, indices) << "\n";
+		}
+
+		void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t nrVertices, std::vector<uint32_t>& clusterOffsets)
+		{
+			const size_t nrTriangles{ indices.size() / 3 };
+
+			// Triangles using every vertex, back to back
+			std::vector<uint32_t> adjacencyOffsets(nrVertices + 1, 0);
+			for (uint32_t index : indices)
+			{
+				++adjacencyOffsets[index + 1];
+			}
+			std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+			std::vector<uint32_t> adjacency(indices.size());
+			{
+				std::vector<uint32_t> nextAdjacencyIdx(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t cornerIdx{ 0 }; cornerIdx < indices.size(); ++cornerIdx)
+				{
+					adjacency[nextAdjacencyIdx[indices[cornerIdx]]++] = static_cast<uint32_t>(cornerIdx / 3);
+				}
+			}
+
+			// Triangles of every vertex that aren't emitted yet
+			std::vector<int> liveTriangles(nrVertices);
+			for (size_t vertIdx{ 0 }; vertIdx < nrVertices; ++vertIdx)
+			{
+				liveTriangles[vertIdx] = static_cast<int>(adjacencyOffsets[vertIdx + 1] - adjacencyOffsets[vertIdx]);
+			}
+			// When every vertex last entered the cache, a vertex is still cached if less than CacheSize entered since
+			std::vector<int> cacheTimes(nrVertices, 0);
+			int time{ CacheSize + 1 };
+
+			std::vector<bool> isEmitted(nrTriangles, false);
+			std::vector<uint32_t> optimizedIndices{};
+			optimizedIndices.reserve(indices.size());
+			// Recently used vertices, to continue from when the fan runs out of candidates
+			std::vector<uint32_t> deadEnds{};
+			std::vector<uint32_t> candidates{};
+			size_t nextInputVertIdx{ 0 };
+
+			const auto skipDeadEnd = [&]() -> int64_t
+			{
+				while (!deadEnds.empty())
+				{
+					const uint32_t vertIdx{ deadEnds.back() };
+					deadEnds.pop_back();
+					if (liveTriangles[vertIdx] > 0) return vertIdx;
+				}
+				for (; nextInputVertIdx < nrVertices; ++nextInputVertIdx)
+				{
+					if (liveTriangles[nextInputVertIdx] > 0) return nextInputVertIdx;
+				}
+				return -1;
+			};
+
+			clusterOffsets.assign(1, 0);
+			int64_t fanVertIdx{ skipDeadEnd() };
+			while (fanVertIdx >= 0)
+			{
+				// Emit every triangle around the fan vertex
+				candidates.clear();
+				for (uint32_t adjacencyIdx{ adjacencyOffsets[fanVertIdx] }; adjacencyIdx < adjacencyOffsets[fanVertIdx + 1]; ++adjacencyIdx)
+				{
+					const uint32_t triangleIdx{ adjacency[adjacencyIdx] };
+					if (isEmitted[triangleIdx]) continue;
+					isEmitted[triangleIdx] = true;
+
+					for (size_t cornerIdx{ triangleIdx * size_t{ 3 } }; cornerIdx < triangleIdx * size_t{ 3 } + 3; ++cornerIdx)
+					{
+						const uint32_t vertIdx{ indices[cornerIdx] };
+						optimizedIndices.push_back(vertIdx);
+						deadEnds.push_back(vertIdx);
+						candidates.push_back(vertIdx);
+						--liveTriangles[vertIdx];
+						if (time - cacheTimes[vertIdx] > CacheSize)
+						{
+							cacheTimes[vertIdx] = time++;
+						}
+					}
+				}
+
+				// Continue with the candidate that has been in the cache the longest,
+				// as long as its own fan still fits before it gets evicted
+				int64_t nextVertIdx{ -1 };
+				int bestPriority{ -1 };
+				for (uint32_t vertIdx : candidates)
+				{
+					if (liveTriangles[vertIdx] == 0) continue;
+
+					const int age{ time - cacheTimes[vertIdx] };
+					const int priority{ age + 2 * liveTriangles[vertIdx] <= CacheSize ? age : 0 };
+					if (priority > bestPriority)
+					{
+						bestPriority = priority;
+						nextVertIdx = vertIdx;
+					}
+				}
+
+				// Nothing left around here, what comes next starts with a cold cache
+				if (nextVertIdx < 0)
+				{
+					nextVertIdx = skipDeadEnd();
+					const uint32_t nrEmittedTriangles{ static_cast<uint32_t>(optimizedIndices.size() / 3) };
+					if (nextVertIdx >= 0 && nrEmittedTriangles != clusterOffsets.back())
+					{
+						clusterOffsets.push_back(nrEmittedTriangles);
+					}
+				}
+				fanVertIdx = nextVertIdx;
+			}
+
+			indices.swap(optimizedIndices);
+		}
+
+		void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusterOffsets)
+		{
+			const size_t nrTriangles{ indices.size() / 3 };
+			const size_t nrClusters{ clusterOffsets.size() };
+			const auto getClusterEnd = [&](size_t clusterIdx)
+			{
+				return clusterIdx + 1 < nrClusters ? clusterOffsets[clusterIdx + 1] : nrTriangles;
+			};
+
+			// Area weighted centroid and normal of every cluster and centroid of the whole mesh
+			std::vector<Vector3> clusterCentroids(nrClusters);
+			std::vector<Vector3> clusterNormals(nrClusters);
+			Vector3 meshCentroid{};
+			float meshArea{};
+			for (size_t clusterIdx{ 0 }; clusterIdx < nrClusters; ++clusterIdx)
+			{
+				Vector3 centroid{};
+				Vector3 normal{};
+				float area{};
+				for (size_t triangleIdx{ clusterOffsets[clusterIdx] }; triangleIdx < getClusterEnd(clusterIdx); ++triangleIdx)
+				{
+					const Vector3& p0{ vertices[indices[triangleIdx * 3]].position };
+					const Vector3& p1{ vertices[indices[triangleIdx * 3 + 1]].position };
+					const Vector3& p2{ vertices[indices[triangleIdx * 3 + 2]].position };
+
+					// The length of the cross product is twice the area
+					const Vector3 cross{ Vector3::Cross(p1 - p0, p2 - p0) };
+					const float triangleArea{ cross.Magnitude() * 0.5f };
+					centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+					normal += cross;
+					area += triangleArea;
+				}
+
+				meshCentroid += centroid;
+				meshArea += area;
+				clusterCentroids[clusterIdx] = area > 0.f ? centroid / area : centroid;
+				clusterNormals[clusterIdx] = normal.SqrMagnitude() > 0.f ? normal.Normalized() : normal;
+			}
+			if (meshArea > 0.f) meshCentroid /= meshArea;
+
+			// Clusters facing away from the center are on the outside of the mesh and are drawn first
+			std::vector<float> sortKeys(nrClusters);
+			for (size_t clusterIdx{ 0 }; clusterIdx < nrClusters; ++clusterIdx)
+			{
+				sortKeys[clusterIdx] = Vector3::Dot(clusterCentroids[clusterIdx] - meshCentroid, clusterNormals[clusterIdx]);
+			}
+			std::vector<size_t> clusterOrder(nrClusters);
+			std::iota(clusterOrder.begin(), clusterOrder.end(), size_t{ 0 });
+			std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			std::vector<uint32_t> optimizedIndices{};
+			optimizedIndices.reserve(indices.size());
+			for (size_t clusterIdx : clusterOrder)
+			{
+				optimizedIndices.insert(optimizedIndices.end(), indices.begin() + clusterOffsets[clusterIdx] * 3, indices.begin() + getClusterEnd(clusterIdx) * 3);
+			}
+			indices.swap(optimizedIndices);
+		}
+
+		void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			constexpr uint32_t unused{ UINT32_MAX };
+			std::vector<uint32_t> remap(vertices.size(), unused);
+			std::vector<Vertex> optimizedVertices{};
+			optimizedVertices.reserve(vertices.size());
+
+			for (uint32_t& index : indices)
+			{
+				if (remap[index] == unused)
+				{
+					remap[index] = static_cast<uint32_t>(optimizedVertices.size());
+					optimizedVertices.push_back(vertices[index]);
+				}
+				index = remap[index];
+			}
+			vertices.swap(optimizedVertices);
+		}
+
+		float GetACMR(const std::vector<uint32_t>& indices, size_t nrVertices)
+		{
+			if (indices.empty()) return 0.f;
+
+			// When every vertex entered the FIFO, 0 if it never did
+			std::vector<size_t> missTimes(nrVertices, 0);
+			size_t nrMisses{ 0 };
+			for (uint32_t index : indices)
+			{
+				if (missTimes[index] == 0 || nrMisses - missTimes[index] >= CacheSize)
+				{
+					missTimes[index] = ++nrMisses;
+				}
+			}
+			return static_cast<float>(nrMisses) / (indices.size() / 3);
+		}
+
+		float GetOverdraw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+		{
+			constexpr int resolution{ 256 };
+
+			Vector3 minBounds{ FLT_MAX, FLT_MAX, FLT_MAX };
+			Vector3 maxBounds{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (const Vertex& vertex : vertices)
+			{
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					minBounds[axis] = std::min(minBounds[axis], vertex.position[axis]);
+					maxBounds[axis] = std::max(maxBounds[axis], vertex.position[axis]);
+				}
+			}
+
+			// Both sides of every triangle are drawn, in index order with a depth test
+			std::vector<float> depthBuffer(resolution * resolution);
+			size_t nrDrawn{ 0 };
+			size_t nrCovered{ 0 };
+			for (int viewAxis{ 0 }; viewAxis < 3; ++viewAxis)
+			{
+				const int axisU{ (viewAxis + 1) % 3 };
+				const int axisV{ (viewAxis + 2) % 3 };
+				const float scaleU{ maxBounds[axisU] > minBounds[axisU] ? resolution / (maxBounds[axisU] - minBounds[axisU]) : 0.f };
+				const float scaleV{ maxBounds[axisV] > minBounds[axisV] ? resolution / (maxBounds[axisV] - minBounds[axisV]) : 0.f };
+
+				for (float viewSign : { 1.f, -1.f })
+				{
+					std::fill(depthBuffer.begin(), depthBuffer.end(), FLT_MAX);
+
+					for (size_t cornerIdx{ 0 }; cornerIdx + 2 < indices.size(); cornerIdx += 3)
+					{
+						float u[3], v[3], depth[3];
+						for (int triVertIdx{ 0 }; triVertIdx < 3; ++triVertIdx)
+						{
+							const Vector3& position{ vertices[indices[cornerIdx + triVertIdx]].position };
+							u[triVertIdx] = (position[axisU] - minBounds[axisU]) * scaleU;
+							v[triVertIdx] = (position[axisV] - minBounds[axisV]) * scaleV;
+							depth[triVertIdx] = position[viewAxis] * viewSign;
+						}
+
+						const float area{ (u[1] - u[0]) * (v[2] - v[0]) - (v[1] - v[0]) * (u[2] - u[0]) };
+						if (area == 0.f) continue;
+						const float invArea{ 1.f / area };
+
+						// Pixels whose center is in the boundingbox
+						const int startX{ std::max(static_cast<int>(std::ceil(std::min({ u[0], u[1], u[2] }) - 0.5f)), 0) };
+						const int endX{ std::min(static_cast<int>(std::floor(std::max({ u[0], u[1], u[2] }) - 0.5f)) + 1, resolution) };
+						const int startY{ std::max(static_cast<int>(std::ceil(std::min({ v[0], v[1], v[2] }) - 0.5f)), 0) };
+						const int endY{ std::min(static_cast<int>(std::floor(std::max({ v[0], v[1], v[2] }) - 0.5f)) + 1, resolution) };
+						for (int py{ startY }; py < endY; ++py)
+						{
+							for (int px{ startX }; px < endX; ++px)
+							{
+								const float pu{ px + 0.5f };
+								const float pv{ py + 0.5f };
+								const float weight0{ ((u[1] - pu) * (v[2] - pv) - (v[1] - pv) * (u[2] - pu)) * invArea };
+								const float weight1{ ((u[2] - pu) * (v[0] - pv) - (v[2] - pv) * (u[0] - pu)) * invArea };
+								const float weight2{ 1.f - weight0 - weight1 };
+								if (weight0 < 0.f || weight1 < 0.f || weight2 < 0.f) continue;
+
+								float& pixelDepth{ depthBuffer[px + py * resolution] };
+								const float interpolatedDepth{ weight0 * depth[0] + weight1 * depth[1] + weight2 * depth[2] };
+								if (interpolatedDepth < pixelDepth)
+								{
+									pixelDepth = interpolatedDepth;
+									++nrDrawn;
+								}
+							}
+						}
+					}
+
+					nrCovered += std::count_if(depthBuffer.begin(), depthBuffer.end(), [](float depth) { return depth != FLT_MAX; });
+				}
+			}
+			return nrCovered ? static_cast<float>(nrDrawn) / nrCovered : 0.f;
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	// Reorders the triangles and vertices of a triangle list at load time
+	// Only the order changes, never what ends up on screen
+	namespace MeshOptimizer
+	{
+		// Entries of the FIFO post-transform cache the orders are optimized and measured for
+		constexpr int CacheSize{ 16 };
+
+		// Runs all the steps below in order, prints the statistics before and after
+		void Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+		// Tipsify (Sander et al. 2007): fans triangles around vertices that are still in the cache
+		// clusterOffsets gets the first triangle of every run that started on a cold cache
+		void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t nrVertices, std::vector<uint32_t>& clusterOffsets);
+		// Puts the clusters that face away from the center of the mesh first, so they hide the rest
+		void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusterOffsets);
+		// Renumbers the vertices in the order they are first used, unused vertices are dropped
+		void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+		// Average cache miss ratio, vertices transformed per triangle
+		float GetACMR(const std::vector<uint32_t>& indices, size_t nrVertices);
+		// Pixels drawn per pixel covered, averaged over orthographic views along the 6 axis directions
+		float GetOverdraw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	}
+}
@@ -0,0 +1,120 @@
+#include "MeshTangents.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace dae
+{
+	namespace MeshTangents
+	{
+		namespace
+		{
+			// Items per job, big enough to be worth one
+			constexpr size_t ChunkSize{ 4096 };
+
+			// job(begin, end) for every chunk of [0, count), on the thread pool if there is one
+			template<typename Job>
+			void ForEachChunk(size_t count, ThreadPool* pThreadPool, const Job& job)
+			{
+				const int nrChunks{ static_cast<int>((count + ChunkSize - 1) / ChunkSize) };
+				const auto chunkJob = [&](int chunkIdx)
+				{
+					const size_t begin{ chunkIdx * ChunkSize };
+					job(begin, std::min(begin + ChunkSize, count));
+				};
+				if (pThreadPool && nrChunks > 1)
+				{
+					pThreadPool->ParallelFor(nrChunks, chunkJob);
+					return;
+				}
+				for (int chunkIdx{ 0 }; chunkIdx < nrChunks; ++chunkIdx)
+				{
+					chunkJob(chunkIdx);
+				}
+			}
+		}
+
+		void Generate(Mesh& mesh, ThreadPool* pThreadPool)
+		{
+			const size_t nrVertices{ mesh.GetNrVertices() };
+			const size_t nrTriangles{ mesh.indices.size() / 3 };
+
+			// Tangent and bitangent of every triangle
+			// Left scaled by the uv area instead of divided by it, only the sign of the area is needed to point them the right way
+			// That also weighs every triangle by its uv area, so slivers in uv space barely count and a zero area doesn't count at all
+			std::vector<Vector3> triangleTangents(nrTriangles);
+			std::vector<Vector3> triangleBitangents(nrTriangles);
+			ForEachChunk(nrTriangles, pThreadPool, [&](size_t begin, size_t end)
+			{
+				for (size_t triangleIdx{ begin }; triangleIdx < end; ++triangleIdx)
+				{
+					const uint32_t* pIndices{ &mesh.indices[triangleIdx * 3] };
+					const Vector3 p0{ mesh.positions.Get(pIndices[0]) };
+					const Vector2 uv0{ mesh.uvs.Get(pIndices[0]) };
+					const Vector3 edge0{ mesh.positions.Get(pIndices[1]) - p0 };
+					const Vector3 edge1{ mesh.positions.Get(pIndices[2]) - p0 };
+					const Vector2 uvEdge0{ mesh.uvs.Get(pIndices[1]) - uv0 };
+					const Vector2 uvEdge1{ mesh.uvs.Get(pIndices[2]) - uv0 };
+
+					const float uvArea{ Vector2::Cross(uvEdge0, uvEdge1) };
+					const float orientation{ uvArea > 0.f ? 1.f : (uvArea < 0.f ? -1.f : 0.f) };
+					triangleTangents[triangleIdx] = (edge0 * uvEdge1.y - edge1 * uvEdge0.y) * orientation;
+					triangleBitangents[triangleIdx] = (edge1 * uvEdge0.x - edge0 * uvEdge1.x) * orientation;
+				}
+			});
+
+			// The triangles around every vertex (CSR), so every vertex sums its own and no two jobs write the same vertex
+			std::vector<uint32_t> adjacencyOffsets(nrVertices + 1);
+			for (const uint32_t index : mesh.indices)
+			{
+				++adjacencyOffsets[index + 1];
+			}
+			for (size_t vertIdx{ 0 }; vertIdx < nrVertices; ++vertIdx)
+			{
+				adjacencyOffsets[vertIdx + 1] += adjacencyOffsets[vertIdx];
+			}
+			std::vector<uint32_t> adjacency(mesh.indices.size());
+			{
+				std::vector<uint32_t> writeOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t cornerIdx{ 0 }; cornerIdx < nrTriangles * 3; ++cornerIdx)
+				{
+					adjacency[writeOffsets[mesh.indices[cornerIdx]]++] = static_cast<uint32_t>(cornerIdx / 3);
+				}
+			}
+
+			mesh.tangents.Resize(nrVertices);
+			mesh.bitangentSigns.resize(nrVertices);
+			ForEachChunk(nrVertices, pThreadPool, [&](size_t begin, size_t end)
+			{
+				for (size_t vertIdx{ begin }; vertIdx < end; ++vertIdx)
+				{
+					Vector3 tangent{};
+					Vector3 bitangent{};
+					for (uint32_t adjacencyIdx{ adjacencyOffsets[vertIdx] }; adjacencyIdx < adjacencyOffsets[vertIdx + 1]; ++adjacencyIdx)
+					{
+						tangent += triangleTangents[adjacency[adjacencyIdx]];
+						bitangent += triangleBitangents[adjacency[adjacencyIdx]];
+					}
+
+					// Gram-Schmidt, perpendicular to the normal
+					const Vector3 normal{ mesh.normals.Get(vertIdx) };
+					const Vector3 rejected{ Vector3::Reject(tangent, normal) };
+					// If nothing is left of it (no uv area, or it was along the normal) any perpendicular axis will do
+					if (rejected.SqrMagnitude() > 1e-6f * tangent.SqrMagnitude())
+					{
+						tangent = rejected.Normalized();
+					}
+					else
+					{
+						tangent = Vector3::Reject(std::abs(normal.x) < 0.9f ? Vector3::UnitX : Vector3::UnitY, normal).Normalized();
+					}
+
+					mesh.tangents.Set(vertIdx, tangent);
+					mesh.bitangentSigns[vertIdx] = Vector3::Dot(Vector3::Cross(normal, tangent), bitangent) < 0.f ? -1.f : 1.f;
+				}
+			});
+		}
+	}
+}
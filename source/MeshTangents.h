@@ -0,0 +1,21 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+	// Tangent space of a triangle list, generated once the vertex streams of a mesh are final
+	namespace MeshTangents
+	{
+		// Fills the tangents and bitangent signs from the positions, normals, uvs and indices
+		// The bitangent is Cross(normal, tangent) * bitangentSign, the sign is -1 where the uvs are mirrored
+		// Vertices without uv area around them get any tangent perpendicular to their normal
+		void Generate(Mesh& mesh, ThreadPool* pThreadPool = nullptr);
+	}
+}
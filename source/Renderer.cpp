@@ -5,11 +5,21 @@
 //Project includes
 #include "Renderer.h"
 #include "Math.h"
+#include "SimdFloat.h"
 #include "Matrix.h"
-#include "Texture.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshTangents.h"
+#include "Material.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
+#include <bit>
+#include <cassert>
+#include <climits>
+#include <cmath>
 #include <iostream>
+#include <utility>
 
 using namespace dae;
 
@@ -24,35 +34,84 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
 	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
 
-	m_pDepthBufferPixels = new float[m_Width * m_Height];
+	// Padded so a full SIMD span can be loaded at the last pixel
+	m_pDepthBufferPixels = new float[m_Width * m_Height + SimdFloat8::Width];
+	m_pVisibilityBuffer = new VisibilityPixel[m_Width * m_Height];
 	ResetDepthBuffer();
+	m_ClearColor = SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100);
+
+	// Largest edge function of a pixel, for a triangle spanning the whole guard band
+	const double maxRasterExtent{ static_cast<double>(m_Camera.guardBand) * std::max(m_Width, m_Height) * m_SubPixelScale };
+	assert(2.0 * maxRasterExtent * maxRasterExtent < INT_MAX && "Edge functions overflow, lower the guard band");
+
+	//Pick the widest rasterizer the CPU supports
+	if (SDL_HasAVX2())
+	{
+		InitShadingKernels<SimdFloat8>(std::make_integer_sequence<int, m_NrShadingKernels>{});
+		m_pTransformVertices = &Renderer::TransformVertices<SimdFloat8>;
+		std::cout << "[SIMD] AVX2, 8 pixels wide\n";
+	}
+	else if (SDL_HasSSE2())
+	{
+		InitShadingKernels<SimdFloat4>(std::make_integer_sequence<int, m_NrShadingKernels>{});
+		m_pTransformVertices = &Renderer::TransformVertices<SimdFloat4>;
+		std::cout << "[SIMD] SSE2, 4 pixels wide\n";
+	}
+	else
+	{
+		InitShadingKernels<SimdFloat1>(std::make_integer_sequence<int, m_NrShadingKernels>{});
+		m_pTransformVertices = &Renderer::TransformVertices<SimdFloat1>;
+		std::cout << "[SIMD] Scalar\n";
+	}
+
+	//Initialize Hierarchical Z, one block per 8x8 pixels
+	m_NrHiZBlocksX = (m_Width + m_HiZBlockSize - 1) / m_HiZBlockSize;
+	m_HiZBlocks.resize(static_cast<size_t>(m_NrHiZBlocksX) * ((m_Height + m_HiZBlockSize - 1) / m_HiZBlockSize));
+
+	//Initialize Tiles
+	m_pThreadPool = new ThreadPool();
+	m_NrTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	m_NrTilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+	m_Tiles.resize(static_cast<size_t>(m_NrTilesX) * m_NrTilesY);
+	for (int tileY{ 0 }; tileY < m_NrTilesY; ++tileY)
+	{
+		for (int tileX{ 0 }; tileX < m_NrTilesX; ++tileX)
+		{
+			Tile& tile{ m_Tiles[tileX + tileY * m_NrTilesX] };
+			tile.topLeft = { tileX * m_TileSize, tileY * m_TileSize };
+			tile.botRight = { std::min((tileX + 1) * m_TileSize, m_Width), std::min((tileY + 1) * m_TileSize, m_Height) };
+		}
+	}
 
 	//Initialize Camera
 	m_Camera.Initialize(45.f, { .0f,.0f,.0f }, static_cast<float>(m_Width) / m_Height);
 
-	//Initialize Texture
-	m_pDiffuseTexture = Texture::LoadFromFile("Resources/vehicle_diffuse.png");
-	m_pSpecularTexture = Texture::LoadFromFile("Resources/vehicle_specular.png");
-	m_pGlossinessTexture = Texture::LoadFromFile("Resources/vehicle_gloss.png");
-	m_pNormalTexture = Texture::LoadFromFile("Resources/vehicle_normal.png");
+	//Initialize Material
+	m_pMaterial = Material::LoadFromFiles("Resources/vehicle_diffuse.png", "Resources/vehicle_normal.png", "Resources/vehicle_specular.png", "Resources/vehicle_gloss.png");
 
 	//Initialize Mesh
 	m_pMesh = new Mesh();
-	Utils::ParseOBJ("Resources/vehicle.obj", m_pMesh->vertices, m_pMesh->indices);
+	if (!MeshCache::Load("Resources/vehicle.obj", *m_pMesh))
+	{
+		std::vector<Vertex> vertices{};
+		Utils::ParseOBJ("Resources/vehicle.obj", vertices, m_pMesh->indices, true, m_pThreadPool);
+		MeshOptimizer::Optimize(vertices, m_pMesh->indices);
+		m_pMesh->SetVertices(vertices);
+		MeshTangents::Generate(*m_pMesh, m_pThreadPool);
+		MeshCache::Save("Resources/vehicle.obj", *m_pMesh);
+	}
 	m_pMesh->Translate(0.f, 0.f, 50.f);
+	m_pMeshes.push_back(m_pMesh);
 }
 
 Renderer::~Renderer()
 {
+	delete m_pThreadPool;
+	m_pThreadPool = nullptr;
 	delete[] m_pDepthBufferPixels;
-	delete m_pDiffuseTexture;
-	m_pDiffuseTexture = nullptr;
-	delete m_pSpecularTexture;
-	m_pSpecularTexture = nullptr;
-	delete m_pGlossinessTexture;
-	m_pGlossinessTexture = nullptr;
-	delete m_pNormalTexture;
-	m_pNormalTexture = nullptr;
+	delete[] m_pVisibilityBuffer;
+	delete m_pMaterial;
+	m_pMaterial = nullptr;
 	delete m_pMesh;
 	m_pMesh = nullptr;
 }
@@ -132,6 +191,50 @@ void Renderer::Update(Timer* pTimer)
 		m_F7Held = true;
 	}
 	else m_F7Held = false;
+	if (pKeyboardState[SDL_SCANCODE_F8])
+	{
+		if (!m_F8Held)
+		{
+			m_EnableDeferredShading = !m_EnableDeferredShading;
+			std::cout << "[DEFERRED] ";
+			std::cout << (m_EnableDeferredShading ? "Deferred shading enabled\n" : "Deferred shading disabled\n");
+		}
+		m_F8Held = true;
+	}
+	else m_F8Held = false;
+	if (pKeyboardState[SDL_SCANCODE_F9])
+	{
+		if (!m_F9Held)
+		{
+			NextCullMode();
+			std::cout << "[CULLMODE] ";
+			switch (m_CullMode)
+			{
+			case dae::Renderer::CullMode::None:
+				std::cout << "None\n";
+				break;
+			case dae::Renderer::CullMode::Back:
+				std::cout << "Back\n";
+				break;
+			case dae::Renderer::CullMode::Front:
+				std::cout << "Front\n";
+				break;
+			}
+		}
+		m_F9Held = true;
+	}
+	else m_F9Held = false;
+	if (pKeyboardState[SDL_SCANCODE_F10])
+	{
+		if (!m_F10Held)
+		{
+			m_EnableFastSpecular = !m_EnableFastSpecular;
+			std::cout << "[SPECULAR] ";
+			std::cout << (m_EnableFastSpecular ? "Fast pow\n" : "Exact pow\n");
+		}
+		m_F10Held = true;
+	}
+	else m_F10Held = false;
 }
 
 void Renderer::Render()
@@ -141,9 +244,6 @@ void Renderer::Render()
 	SDL_LockSurface(m_pBackBuffer);
 
 	// Define Triangles - Vertices in WORLD space
-	std::vector<Mesh> meshes_world;
-	// can be optimised
-	meshes_world.push_back(*m_pMesh);
 	//{
 	//	Mesh
 	//	{
@@ -176,47 +276,38 @@ void Renderer::Render()
 	//	}
 	//};
 
+	// The modes only change between frames, so the shading is picked once for the whole frame
+	const int shadingKernelIdx{ GetShadingKernelIdx() };
+	m_pRenderMeshTriangle = m_EnableDeferredShading ? m_RenderMeshTriangleDeferred : m_RenderMeshTriangleKernels[shadingKernelIdx];
+	m_pResolveTile = m_ResolveTileKernels[shadingKernelIdx];
+
+	// Every tile clears its own part of the buffers
+	const int nrTiles{ static_cast<int>(m_Tiles.size()) };
+	m_pThreadPool->ParallelFor(nrTiles, [this](int tileIdx) { ClearTile(m_Tiles[tileIdx]); });
+
 	// For each mesh
-	for (auto& mesh : meshes_world)
+	for (m_CurrentMeshIdx = 0; m_CurrentMeshIdx < static_cast<int>(m_pMeshes.size()); ++m_CurrentMeshIdx)
 	{
-		// World space --> NDC Space
-		VertexTransformationFunction(mesh);
-
-		std::vector<Vector2> vertices_raster;
-		for (const Vertex_Out& ndcVertex : mesh.vertices_out)
-		{
-			// Formula from slides
-			// NDC --> Screenspace
-			vertices_raster.push_back({ (ndcVertex.position.x + 1) / 2.0f * m_Width, (1.0f - ndcVertex.position.y) / 2.0f * m_Height });
-		}
+		Mesh& mesh{ *m_pMeshes[m_CurrentMeshIdx] };
 
-		// Depth buffer
-		ResetDepthBuffer();
-		ClearBackground();
+		// World space --> NDC Space --> Screenspace
+		VertexTransformationFunction(mesh);
+		// Replaces the triangles that can't be rasterized as is
+		ClipMeshTriangles(mesh);
 
 		// +--------------+
 		// | RENDER LOGIC |
 		// +--------------+
-			switch (mesh.primitiveTopology)
-			{
-			case PrimitiveTopology::TriangleList:
-				// For each triangle
-				for (int currStartVertIdx{0}; currStartVertIdx < mesh.indices.size(); currStartVertIdx += 3)
-				{
-					RenderMeshTriangle(mesh, vertices_raster, currStartVertIdx, false);
-				}
-				break;
-			case PrimitiveTopology::TriangleStrip:
-				// For each triangle
-				for (int currStartVertIdx{0}; currStartVertIdx < mesh.indices.size() - 2; ++currStartVertIdx)
-				{
-					RenderMeshTriangle(mesh, vertices_raster, currStartVertIdx, currStartVertIdx % 2);
-				}
-				break;
-			default:
-				std::cout << "PrimitiveTopology not implemented yet\n";
-				break;
-			}
+		BinMeshTriangles(mesh);
+
+		// Tiles don't overlap, so they can be rasterized in parallel
+		m_pThreadPool->ParallelFor(nrTiles, [&](int tileIdx) { RenderTile(mesh, m_Tiles[tileIdx]); });
+	}
+
+	// Only now is it known which triangle ends up in front
+	if (m_EnableDeferredShading)
+	{
+		m_pThreadPool->ParallelFor(nrTiles, [&](int tileIdx) { (this->*m_pResolveTile)(m_Tiles[tileIdx]); });
 	}
 
 	//@END
@@ -228,173 +319,982 @@ void Renderer::Render()
 
 void dae::Renderer::VertexTransformationFunction(Mesh& mesh)
 {
-	Matrix worldViewProjectionMatrix{ mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix };
-	mesh.vertices_out.clear();
-	mesh.vertices_out.reserve(mesh.vertices.size());
+	const Matrix worldViewProjectionMatrix{ mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix };
+
+	// Drops the vertices the clipper added last frame, the capacity stays
+	const size_t nrVertices{ mesh.GetNrVertices() };
+	mesh.ResizeVerticesOut(nrVertices);
+	mesh.vertices_raster.resize(nrVertices);
+	m_ClipCodes.resize(nrVertices);
+
+	// Big enough to be worth a job, a multiple of every SIMD width
+	constexpr size_t chunkSize{ 2048 };
+	const int nrChunks{ static_cast<int>((nrVertices + chunkSize - 1) / chunkSize) };
+	m_pThreadPool->ParallelFor(nrChunks, [&](int chunkIdx)
+	{
+		const size_t firstVertIdx{ chunkIdx * chunkSize };
+		(this->*m_pTransformVertices)(mesh, worldViewProjectionMatrix, firstVertIdx, std::min(firstVertIdx + chunkSize, nrVertices));
+	});
+}
+
+template<typename SimdFloat>
+void dae::Renderer::TransformVertices(Mesh& mesh, const Matrix& worldViewProjectionMatrix, size_t firstVertIdx, size_t endVertIdx)
+{
+	// Every matrix element in every lane
+	SimdFloat worldViewProjection[4][4];
+	SimdFloat world[3][3];
+	for (int row{ 0 }; row < 4; ++row)
+	{
+		for (int column{ 0 }; column < 4; ++column)
+		{
+			worldViewProjection[row][column] = worldViewProjectionMatrix[row][column];
+			if (row < 3 && column < 3) world[row][column] = mesh.worldMatrix[row][column];
+		}
+	}
+
+	const SimdFloat zero{ 0.f };
+	const SimdFloat one{ 1.f };
+	const SimdFloat guardBand{ m_Camera.guardBand };
+	const SimdFloat rasterScaleX{ 0.5f * m_Width * m_SubPixelScale };
+	const SimdFloat rasterScaleY{ 0.5f * m_Height * m_SubPixelScale };
 
-	for (const Vertex& v : mesh.vertices)
+	size_t vertIdx{ firstVertIdx };
+	for (; vertIdx + SimdFloat::Width <= endVertIdx; vertIdx += SimdFloat::Width)
 	{
-		Vertex_Out vertex_out{ Vector4{}, v.color, v.uv, v.normal, v.tangent };
+		// Matrix::TransformPoint and TransformVector, for Width vertices at once
+		const auto transformPoint = [&](const Vector3Stream& stream, const SimdFloat (&matrix)[4][4], int column)
+		{
+			return matrix[0][column] * SimdFloat::Load(&stream.x[vertIdx]) + matrix[1][column] * SimdFloat::Load(&stream.y[vertIdx])
+				+ matrix[2][column] * SimdFloat::Load(&stream.z[vertIdx]) + matrix[3][column];
+		};
+		const auto transformVector = [&](const Vector3Stream& stream, Vector3Stream& streamOut)
+		{
+			const SimdFloat x{ SimdFloat::Load(&stream.x[vertIdx]) };
+			const SimdFloat y{ SimdFloat::Load(&stream.y[vertIdx]) };
+			const SimdFloat z{ SimdFloat::Load(&stream.z[vertIdx]) };
+			(world[0][0] * x + world[1][0] * y + world[2][0] * z).Store(&streamOut.x[vertIdx]);
+			(world[0][1] * x + world[1][1] * y + world[2][1] * z).Store(&streamOut.y[vertIdx]);
+			(world[0][2] * x + world[1][2] * y + world[2][2] * z).Store(&streamOut.z[vertIdx]);
+		};
 
-		vertex_out.position = worldViewProjectionMatrix.TransformPoint({ v.position, 1.0f });
-		vertex_out.viewDirection = Vector3{ vertex_out.position.x, vertex_out.position.y, vertex_out.position.z }.Normalized();
+		// World space --> Clip space
+		const SimdFloat clipX{ transformPoint(mesh.positions, worldViewProjection, 0) };
+		const SimdFloat clipY{ transformPoint(mesh.positions, worldViewProjection, 1) };
+		const SimdFloat clipZ{ transformPoint(mesh.positions, worldViewProjection, 2) };
+		const SimdFloat clipW{ transformPoint(mesh.positions, worldViewProjection, 3) };
 
-		vertex_out.normal = mesh.worldMatrix.TransformVector(v.normal);
-		vertex_out.tangent = mesh.worldMatrix.TransformVector(v.tangent);
+		const SimdFloat invLength{ one / SimdFloat::Sqrt(clipX * clipX + clipY * clipY + clipZ * clipZ) };
+		(clipX * invLength).Store(&mesh.viewDirections_out.x[vertIdx]);
+		(clipY * invLength).Store(&mesh.viewDirections_out.y[vertIdx]);
+		(clipZ * invLength).Store(&mesh.viewDirections_out.z[vertIdx]);
 
+		transformVector(mesh.normals, mesh.normals_out);
+		transformVector(mesh.tangents, mesh.tangents_out);
 
-		const float invVw{1/vertex_out.position.w};
-		vertex_out.position.x *= invVw;
-		vertex_out.position.y *= invVw;
-		vertex_out.position.z *= invVw;
+		// One bit per lane for every plane, negative Camera::GetClipDistance is outside
+		int outsideBits[Camera::ClipPlaneCount];
+		for (int planeIdx{ 0 }; planeIdx < Camera::ClipPlaneCount; ++planeIdx)
+		{
+			outsideBits[planeIdx] = (Camera::GetClipDistance(clipX, clipY, clipZ, clipW, guardBand, planeIdx) < zero).GetBits();
+		}
+		for (int lane{ 0 }; lane < SimdFloat::Width; ++lane)
+		{
+			uint8_t clipCode{};
+			for (int planeIdx{ 0 }; planeIdx < Camera::ClipPlaneCount; ++planeIdx)
+			{
+				clipCode |= ((outsideBits[planeIdx] >> lane) & 1) << planeIdx;
+			}
+			m_ClipCodes[vertIdx + lane] = clipCode;
+		}
+
+		// Perspective divide, vertices that are outside are only used by triangles that get clipped
+		const SimdFloat invW{ one / clipW };
+		const SimdFloat ndcX{ clipX * invW };
+		const SimdFloat ndcY{ clipY * invW };
+		ndcX.Store(&mesh.positions_out.x[vertIdx]);
+		ndcY.Store(&mesh.positions_out.y[vertIdx]);
+		(clipZ * invW).Store(&mesh.positions_out.z[vertIdx]);
+		clipW.Store(&mesh.positions_out.w[vertIdx]);
 
-		// emplace back because we made vOut just to store in this vector
-		mesh.vertices_out.emplace_back(vertex_out);
+		// Same as GetRasterPosition
+		SimdFloat::Int::StoreInterleaved(&mesh.vertices_raster[vertIdx].x, ((ndcX + one) * rasterScaleX).RoundToInt(), ((one - ndcY) * rasterScaleY).RoundToInt());
+	}
+
+	if constexpr (SimdFloat::Width > 1)
+	{
+		if (vertIdx < endVertIdx) TransformVertices<SimdFloat1>(mesh, worldViewProjectionMatrix, vertIdx, endVertIdx);
 	}
 }
 
-void dae::Renderer::RenderMeshTriangle(const Mesh& mesh, const std::vector<Vector2>& vertices_raster, int currStartVertIdx, bool swapVertices)
+dae::Int2 dae::Renderer::GetRasterPosition(const Vector4& ndcPosition) const
 {
-	const size_t vertIdx0{mesh.indices[currStartVertIdx + (2 * swapVertices)] };
-	const size_t vertIdx1{ mesh.indices[currStartVertIdx + 1] };
-	const size_t vertIdx2{ mesh.indices[currStartVertIdx + (!swapVertices * 2)] };
+	// Formula from slides
+	const float rasterScaleX{ 0.5f * m_Width * m_SubPixelScale };
+	const float rasterScaleY{ 0.5f * m_Height * m_SubPixelScale };
+	return { static_cast<int>(lrintf((ndcPosition.x + 1.f) * rasterScaleX)), static_cast<int>(lrintf((1.f - ndcPosition.y) * rasterScaleY)) };
+}
 
-	// If a triangle has the same vertex twice, it means it has no surface and can't be rendered.
-	if (vertIdx0 == vertIdx1 || vertIdx1 == vertIdx2 || vertIdx2 == vertIdx0)
+void dae::Renderer::ClipMeshTriangles(Mesh& mesh)
+{
+	// Only the vertices of the clipped triangles need their clip space position, so it is not kept around
+	const Matrix worldViewProjectionMatrix{ mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix };
+
+	mesh.clippedIndices.clear();
+	const int nrMeshTriangles{ GetNrMeshTriangles(mesh) };
+	for (int triangleIdx{ 0 }; triangleIdx < nrMeshTriangles; ++triangleIdx)
 	{
-		return;
+		size_t vertIndices[3];
+		GetTriangleIndices(mesh, triangleIdx, vertIndices[0], vertIndices[1], vertIndices[2]);
+		const uint8_t clipCode0{ m_ClipCodes[vertIndices[0]] };
+		const uint8_t clipCode1{ m_ClipCodes[vertIndices[1]] };
+		const uint8_t clipCode2{ m_ClipCodes[vertIndices[2]] };
+
+		// Fully inside, nothing to do. Fully outside one plane, nothing to draw.
+		if ((clipCode0 | clipCode1 | clipCode2) == 0 || (clipCode0 & clipCode1 & clipCode2) != 0) continue;
+
+		// Sutherland-Hodgman against every plane that is crossed, in homogeneous space
+		// Every plane can add at most one vertex
+		constexpr int maxPolygonSize{ 3 + Camera::ClipPlaneCount };
+		Vertex_Out polygon[maxPolygonSize];
+		for (int triVertIdx{ 0 }; triVertIdx < 3; ++triVertIdx)
+		{
+			polygon[triVertIdx] = mesh.GetVertexOut(vertIndices[triVertIdx]);
+			polygon[triVertIdx].position = worldViewProjectionMatrix.TransformPoint(Vector4{ mesh.positions.Get(vertIndices[triVertIdx]), 1.f });
+		}
+		Vertex_Out clippedPolygon[maxPolygonSize];
+		int polygonSize{ 3 };
+
+		const uint8_t crossedPlanes{ static_cast<uint8_t>(clipCode0 | clipCode1 | clipCode2) };
+		for (int planeIdx{ 0 }; planeIdx < Camera::ClipPlaneCount && polygonSize >= 3; ++planeIdx)
+		{
+			if (!(crossedPlanes & (1 << planeIdx))) continue;
+
+			int clippedSize{ 0 };
+			for (int polyVertIdx{ 0 }; polyVertIdx < polygonSize; ++polyVertIdx)
+			{
+				const Vertex_Out& current{ polygon[polyVertIdx] };
+				const Vertex_Out& next{ polygon[(polyVertIdx + 1) % polygonSize] };
+				const float currentDistance{ m_Camera.GetClipDistance(current.position, planeIdx) };
+				const float nextDistance{ m_Camera.GetClipDistance(next.position, planeIdx) };
+
+				if (currentDistance >= 0.f)
+				{
+					clippedPolygon[clippedSize++] = current;
+				}
+				if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+				{
+					clippedPolygon[clippedSize++] = LerpVertex(current, next, currentDistance / (currentDistance - nextDistance));
+				}
+			}
+
+			std::copy_n(clippedPolygon, clippedSize, polygon);
+			polygonSize = clippedSize;
+		}
+		if (polygonSize < 3) continue;
+
+		// Triangle fan, keeps the winding of the original triangle
+		const uint32_t firstVertIdx{ static_cast<uint32_t>(mesh.positions_out.GetSize()) };
+		for (int polyVertIdx{ 0 }; polyVertIdx < polygonSize; ++polyVertIdx)
+		{
+			// Perspective divide
+			Vertex_Out& vertex_out{ polygon[polyVertIdx] };
+			const float invVw{ 1 / vertex_out.position.w };
+			vertex_out.position.x *= invVw;
+			vertex_out.position.y *= invVw;
+			vertex_out.position.z *= invVw;
+
+			mesh.PushBackVertexOut(vertex_out);
+			mesh.vertices_raster.push_back(GetRasterPosition(vertex_out.position));
+		}
+		for (int fanIdx{ 1 }; fanIdx < polygonSize - 1; ++fanIdx)
+		{
+			mesh.clippedIndices.push_back(firstVertIdx);
+			mesh.clippedIndices.push_back(firstVertIdx + fanIdx);
+			mesh.clippedIndices.push_back(firstVertIdx + fanIdx + 1);
+		}
 	}
-	if (m_Camera.ShouldVertexBeClipped(mesh.vertices_out[vertIdx0].position) || m_Camera.ShouldVertexBeClipped(mesh.vertices_out[vertIdx1].position) || m_Camera.ShouldVertexBeClipped(mesh.vertices_out[vertIdx2].position))
+}
+
+Vertex_Out dae::Renderer::LerpVertex(const Vertex_Out& v0, const Vertex_Out& v1, float t)
+{
+	Vertex_Out result{};
+	result.position = v0.position + (v1.position - v0.position) * t;
+	result.uv = v0.uv + (v1.uv - v0.uv) * t;
+	result.normal = v0.normal + (v1.normal - v0.normal) * t;
+	result.tangent = v0.tangent + (v1.tangent - v0.tangent) * t;
+	result.bitangentSign = v0.bitangentSign + (v1.bitangentSign - v0.bitangentSign) * t;
+	result.viewDirection = v0.viewDirection + (v1.viewDirection - v0.viewDirection) * t;
+	return result;
+}
+
+void dae::Renderer::ClearTile(const Tile& tile)
+{
+	const int tileWidth{ tile.botRight.x - tile.topLeft.x };
+	for (int py{ tile.topLeft.y }; py < tile.botRight.y; ++py)
+	{
+		const int rowStartIdx{ tile.topLeft.x + py * m_Width };
+		std::fill_n(m_pBackBufferPixels + rowStartIdx, tileWidth, m_ClearColor);
+		std::fill_n(m_pDepthBufferPixels + rowStartIdx, tileWidth, FLT_MAX);
+		if (m_EnableDeferredShading)
+		{
+			std::fill_n(m_pVisibilityBuffer + rowStartIdx, tileWidth, VisibilityPixel{});
+		}
+	}
+
+	for (int blockY{ tile.topLeft.y / m_HiZBlockSize }; blockY * m_HiZBlockSize < tile.botRight.y; ++blockY)
 	{
+		for (int blockX{ tile.topLeft.x / m_HiZBlockSize }; blockX * m_HiZBlockSize < tile.botRight.x; ++blockX)
+		{
+			m_HiZBlocks[blockX + blockY * m_NrHiZBlocksX] = HiZBlock{};
+		}
+	}
+}
+
+float dae::Renderer::GetHiZMaxDepth(HiZBlock& block, int blockX, int blockY) const
+{
+	if (block.isMaxDirty)
+	{
+		const int startX{ blockX * m_HiZBlockSize };
+		const int startY{ blockY * m_HiZBlockSize };
+		const int endX{ std::min(startX + m_HiZBlockSize, m_Width) };
+		const int endY{ std::min(startY + m_HiZBlockSize, m_Height) };
+
+		float maxDepth{ 0.f };
+		for (int py{ startY }; py < endY; ++py)
+		{
+			const float* pRow{ m_pDepthBufferPixels + py * m_Width };
+			maxDepth = std::max(maxDepth, *std::max_element(pRow + startX, pRow + endX));
+		}
+		block.maxDepth = maxDepth;
+		block.isMaxDirty = false;
+	}
+	return block.maxDepth;
+}
+
+void dae::Renderer::BinMeshTriangles(const Mesh& mesh)
+{
+	for (Tile& tile : m_Tiles)
+	{
+		tile.nrBinnedTriangles = 0;
+	}
+
+	if (mesh.primitiveTopology != PrimitiveTopology::TriangleList && mesh.primitiveTopology != PrimitiveTopology::TriangleStrip)
+	{
+		std::cout << "PrimitiveTopology not implemented yet\n";
 		return;
 	}
 
-	const Vector2 vert0{ vertices_raster[vertIdx0] };
-	const Vector2 vert1{ vertices_raster[vertIdx1] };
-	const Vector2 vert2{ vertices_raster[vertIdx2] };
+	const int nrMeshTriangles{ GetNrMeshTriangles(mesh) };
+	const int nrTriangles{ nrMeshTriangles + static_cast<int>(mesh.clippedIndices.size()) / 3 };
+
+	// Counting sort: count the triangles of every tile first, so they all fit in m_BinnedTriangles without reallocating per tile
+	m_TriangleTileRanges.resize(nrTriangles);
+
+	// For each triangle
+	for (int triangleIdx{ 0 }; triangleIdx < nrTriangles; ++triangleIdx)
+	{
+		TileRange& tileRange{ m_TriangleTileRanges[triangleIdx] };
+		tileRange = TileRange{};
+
+		size_t vertIdx0, vertIdx1, vertIdx2;
+		GetTriangleIndices(mesh, triangleIdx, vertIdx0, vertIdx1, vertIdx2);
+
+		// If a triangle has the same vertex twice, it means it has no surface and can't be rendered.
+		if (vertIdx0 == vertIdx1 || vertIdx1 == vertIdx2 || vertIdx2 == vertIdx0)
+		{
+			continue;
+		}
+		// Either rejected or replaced by clipped triangles
+		if (triangleIdx < nrMeshTriangles && (m_ClipCodes[vertIdx0] | m_ClipCodes[vertIdx1] | m_ClipCodes[vertIdx2]) != 0)
+		{
+			continue;
+		}
+
+		const Int2& vert0{ mesh.vertices_raster[vertIdx0] };
+		const Int2& vert1{ mesh.vertices_raster[vertIdx1] };
+		const Int2& vert2{ mesh.vertices_raster[vertIdx2] };
+
+		// Positive area means the triangle faces the camera, zero means it is degenerate after snapping
+		const int64_t signedArea{ GetSignedArea(vert0, vert1, vert2) };
+		if (signedArea == 0 || (m_CullMode == CullMode::Back && signedArea < 0) || (m_CullMode == CullMode::Front && signedArea > 0))
+		{
+			continue;
+		}
+
+		// Also rejects triangles too small to contain a single pixel center
+		Int2 bbTopLeft, bbBotRight;
+		GetTriangleBoundingBox(vert0, vert1, vert2, bbTopLeft, bbBotRight);
+		if (bbTopLeft.x >= bbBotRight.x || bbTopLeft.y >= bbBotRight.y)
+		{
+			continue;
+		}
+
+		tileRange.first = { bbTopLeft.x / m_TileSize, bbTopLeft.y / m_TileSize };
+		tileRange.last = { (bbBotRight.x - 1) / m_TileSize, (bbBotRight.y - 1) / m_TileSize };
+		for (int tileY{ tileRange.first.y }; tileY <= tileRange.last.y; ++tileY)
+		{
+			for (int tileX{ tileRange.first.x }; tileX <= tileRange.last.x; ++tileX)
+			{
+				++m_Tiles[tileX + tileY * m_NrTilesX].nrBinnedTriangles;
+			}
+		}
+	}
 
-	// Boundingbox (bb)
-	Vector2 bbTopLeft{ Vector2::Min(vert0,Vector2::Min(vert1,vert2))};
-	Vector2 bbBotRight{ Vector2::Max(vert0,Vector2::Max(vert1,vert2)) };
+	int nrBinnedTriangles{ 0 };
+	for (Tile& tile : m_Tiles)
+	{
+		tile.firstBinnedIdx = nrBinnedTriangles;
+		nrBinnedTriangles += tile.nrBinnedTriangles;
+		tile.nrBinnedTriangles = 0;
+	}
+	m_BinnedTriangles.resize(nrBinnedTriangles);
 
-	const float margin{ 1.f };
-	// Add margin to prevent seethrough lines between quads
+	// Going over the triangles in order keeps the draw order within a tile
+	for (int triangleIdx{ 0 }; triangleIdx < nrTriangles; ++triangleIdx)
 	{
-		const Vector2 marginVect{ margin,margin };
-		bbTopLeft -= marginVect;
-		bbBotRight += marginVect;
+		const TileRange& tileRange{ m_TriangleTileRanges[triangleIdx] };
+		for (int tileY{ tileRange.first.y }; tileY <= tileRange.last.y; ++tileY)
+		{
+			for (int tileX{ tileRange.first.x }; tileX <= tileRange.last.x; ++tileX)
+			{
+				Tile& tile{ m_Tiles[tileX + tileY * m_NrTilesX] };
+				m_BinnedTriangles[tile.firstBinnedIdx + tile.nrBinnedTriangles++] = triangleIdx;
+			}
+		}
 	}
+}
 
-	// Make sure the boundingbox is on the screen
-	bbTopLeft.x = Clamp(bbTopLeft.x, 0.f, static_cast<float>(m_Width));
-	bbTopLeft.y = Clamp(bbTopLeft.y, 0.f, static_cast<float>(m_Height));
-	bbBotRight.x = Clamp(bbBotRight.x, 0.f, static_cast<float>(m_Width));
-	bbBotRight.y = Clamp(bbBotRight.y, 0.f, static_cast<float>(m_Height));
+void dae::Renderer::RenderTile(const Mesh& mesh, const Tile& tile)
+{
+	for (int binnedIdx{ tile.firstBinnedIdx }; binnedIdx < tile.firstBinnedIdx + tile.nrBinnedTriangles; ++binnedIdx)
+	{
+		(this->*m_pRenderMeshTriangle)(mesh, m_BinnedTriangles[binnedIdx], tile);
+	}
+}
 
-	const int startX{ static_cast<int>(bbTopLeft.x) };
-	const int endX{ static_cast<int>(bbBotRight.x) };
-	const int startY{ static_cast<int>(bbTopLeft.y) };
-	const int endY{ static_cast<int>(bbBotRight.y) };
+template<Renderer::ShadingKernel kernel>
+void dae::Renderer::ResolveTile(const Tile& tile)
+{
+	// Pixels next to each other mostly show the same triangle, so its setup is only redone when the triangle changes
+	int setupMeshIdx{ -1 };
+	int setupTriangleIdx{ -1 };
+	TriangleSetup setup{};
+	UVGradients uvGradients{};
 
-	// For each pixel
-	for (int px{ startX }; px < endX; ++px)
+	for (int py{ tile.topLeft.y }; py < tile.botRight.y; ++py)
 	{
-		for (int py{ startY }; py < endY; ++py)
+		for (int px{ tile.topLeft.x }; px < tile.botRight.x; ++px)
 		{
-			const Vector2 currentPixel{ static_cast<float>(px),static_cast<float>(py) };
 			const int pixelIdx{ px + py * m_Width };
-			// Cross products for weights go to waste, optimalisation is possible
-			const bool hitTriangle{ Utils::IsInTriangle(currentPixel,vert0,vert1,vert2) };
-			if (hitTriangle)
+			const VisibilityPixel& visibility{ m_pVisibilityBuffer[pixelIdx] };
+			if (visibility.triangleIdx < 0) continue;
+
+			if (visibility.triangleIdx != setupTriangleIdx || visibility.meshIdx != setupMeshIdx)
 			{
-				
-				// weights
-				float weight0, weight1, weight2;
-				weight0 = Vector2::Cross((currentPixel - vert1), (vert1 - vert2));
-				weight1 = Vector2::Cross((currentPixel - vert2), (vert2 - vert0));
-				weight2 = Vector2::Cross((currentPixel - vert0), (vert0 - vert1));
-				// divide by total triangle area
-				const float totalTriangleArea{ Vector2::Cross(vert1 - vert0,vert2 - vert0) };
-				const float invTotalTriangleArea{ 1 / totalTriangleArea };
-				weight0 *= invTotalTriangleArea;
-				weight1 *= invTotalTriangleArea;
-				weight2 *= invTotalTriangleArea;
-
-				const float depth0{ mesh.vertices_out[vertIdx0].position.z };
-				const float depth1{ mesh.vertices_out[vertIdx1].position.z };
-				const float depth2{ mesh.vertices_out[vertIdx2].position.z };
-				const float interpolatedDepth{1.f / (weight0 * (1.f / depth0) + weight1 * (1.f / depth1) + weight2 * (1.f / depth2))};
-				if (m_pDepthBufferPixels[pixelIdx] < interpolatedDepth || interpolatedDepth < 0.f || interpolatedDepth > 1.f) continue;
-
-				m_pDepthBufferPixels[pixelIdx] = interpolatedDepth;
+				const Mesh& mesh{ *m_pMeshes[visibility.meshIdx] };
+				size_t vertIndices[3];
+				GetTriangleIndices(mesh, visibility.triangleIdx, vertIndices[0], vertIndices[1], vertIndices[2]);
+				SetupTriangle(mesh, vertIndices, kernel.GetAttributeMask(), setup);
+				if constexpr (kernel.UsesUV())
+				{
+					uvGradients = GetUVGradients(setup);
+				}
+				setupMeshIdx = visibility.meshIdx;
+				setupTriangleIdx = visibility.triangleIdx;
+			}
 
-				Vertex_Out pixel{};
-				pixel.position = { currentPixel.x,currentPixel.y, interpolatedDepth,interpolatedDepth };
-				pixel.uv = interpolatedDepth * ((weight0 * mesh.vertices[vertIdx0].uv) / depth0 + (weight1 * mesh.vertices[vertIdx1].uv) / depth1 + (weight2 * mesh.vertices[vertIdx2].uv) / depth2);
-				pixel.normal = Vector3{ interpolatedDepth * (weight0 * mesh.vertices_out[vertIdx0].normal / mesh.vertices_out[vertIdx0].position.w + weight1 * mesh.vertices_out[vertIdx1].normal / mesh.vertices_out[vertIdx1].position.w + weight2 * mesh.vertices_out[vertIdx2].normal / mesh.vertices_out[vertIdx2].position.w)}.Normalized();
-				pixel.tangent = Vector3{ interpolatedDepth * (weight0 * mesh.vertices_out[vertIdx0].tangent / mesh.vertices_out[vertIdx0].position.w + weight1 * mesh.vertices_out[vertIdx1].tangent / mesh.vertices_out[vertIdx1].position.w + weight2 * mesh.vertices_out[vertIdx2].tangent / mesh.vertices_out[vertIdx2].position.w)}.Normalized();
-				pixel.viewDirection = Vector3{interpolatedDepth * (weight0 * mesh.vertices_out[vertIdx0].viewDirection / mesh.vertices_out[vertIdx0].position.w +weight1 * mesh.vertices_out[vertIdx1].viewDirection / mesh.vertices_out[vertIdx1].position.w +weight2 * mesh.vertices_out[vertIdx2].viewDirection / mesh.vertices_out[vertIdx2].position.w)}.Normalized();
+			const float weight0{ 1.f - visibility.weight1 - visibility.weight2 };
+			const float interpolatedDepth{ m_pDepthBufferPixels[pixelIdx] };
+			const auto interpolate = [&](int attributeIdx)
+			{
+				return (weight0 * setup.attributes[0][attributeIdx] + visibility.weight1 * setup.attributes[1][attributeIdx] + visibility.weight2 * setup.attributes[2][attributeIdx]) * interpolatedDepth;
+			};
 
-				PixelShading(pixel);
+			Vertex_Out pixel{};
+			pixel.position = { static_cast<float>(px),static_cast<float>(py), interpolatedDepth,interpolatedDepth };
+			if constexpr (kernel.UsesUV())
+			{
+				pixel.uv = { interpolate(0), interpolate(1) };
+				pixel.uvDdx = (uvGradients.uvDdx - pixel.uv * uvGradients.invDepthDdx) * interpolatedDepth;
+				pixel.uvDdy = (uvGradients.uvDdy - pixel.uv * uvGradients.invDepthDdy) * interpolatedDepth;
 			}
+			if constexpr (kernel.UsesNormal())
+				pixel.normal = Vector3{ interpolate(2), interpolate(3), interpolate(4) }.Normalized();
+			if constexpr (kernel.UsesTangent())
+			{
+				pixel.tangent = Vector3{ interpolate(5), interpolate(6), interpolate(7) }.Normalized();
+				pixel.bitangentSign = interpolate(11);
+			}
+			if constexpr (kernel.UsesViewDirection())
+				pixel.viewDirection = Vector3{ interpolate(8), interpolate(9), interpolate(10) }.Normalized();
+
+			PixelShading<kernel>(pixel);
 		}
 	}
 }
 
-void dae::Renderer::PixelShading(const Vertex_Out& v)
+int dae::Renderer::GetNrMeshTriangles(const Mesh& mesh) const
+{
+	switch (mesh.primitiveTopology)
+	{
+	case PrimitiveTopology::TriangleList:
+		return static_cast<int>(mesh.indices.size()) / 3;
+	case PrimitiveTopology::TriangleStrip:
+		return std::max(static_cast<int>(mesh.indices.size()) - 2, 0);
+	default:
+		return 0;
+	}
+}
+
+void dae::Renderer::GetTriangleIndices(const Mesh& mesh, int triangleIdx, size_t& vertIdx0, size_t& vertIdx1, size_t& vertIdx2) const
 {
-	Vector3 normal{v.normal};
+	const int nrMeshTriangles{ GetNrMeshTriangles(mesh) };
+	if (triangleIdx >= nrMeshTriangles)
+	{
+		const size_t currStartVertIdx{ static_cast<size_t>(triangleIdx - nrMeshTriangles) * 3 };
+		vertIdx0 = mesh.clippedIndices[currStartVertIdx];
+		vertIdx1 = mesh.clippedIndices[currStartVertIdx + 1];
+		vertIdx2 = mesh.clippedIndices[currStartVertIdx + 2];
+		return;
+	}
 
-	ColorRGB finalColor{};
+	const bool isStrip{ mesh.primitiveTopology == PrimitiveTopology::TriangleStrip };
+	const int currStartVertIdx{ isStrip ? triangleIdx : triangleIdx * 3 };
+	// Every odd triangle of a strip has its winding flipped
+	const bool swapVertices{ isStrip && currStartVertIdx % 2 };
+
+	vertIdx0 = mesh.indices[currStartVertIdx + (2 * swapVertices)];
+	vertIdx1 = mesh.indices[currStartVertIdx + 1];
+	vertIdx2 = mesh.indices[currStartVertIdx + (!swapVertices * 2)];
+}
 
-	if (m_EnableNormalMap)
+void dae::Renderer::SetupTriangle(const Mesh& mesh, const size_t vertIndices[3], uint32_t attributeMask, TriangleSetup& setup) const
+{
+	// The weights are the edge functions divided by the total area, see RenderMeshTriangle
+	// The signs of both flip with the winding, so they cancel
+	const Int2 verts[3]{ mesh.vertices_raster[vertIndices[0]], mesh.vertices_raster[vertIndices[1]], mesh.vertices_raster[vertIndices[2]] };
+	const float scale{ m_SubPixelScale / static_cast<float>(GetSignedArea(verts[0], verts[1], verts[2])) };
+	const Vector3Stream* const pStreams[3]{ &mesh.normals_out, &mesh.tangents_out, &mesh.viewDirections_out };
+	for (int triVertIdx{ 0 }; triVertIdx < 3; ++triVertIdx)
 	{
-		const Vector3 binormal = Vector3::Cross(v.normal, v.tangent);
-		const Matrix tangentSpaceAxis = Matrix{ v.tangent,binormal,v.normal,Vector3::Zero };
+		// Vertices of the edge opposite of this one
+		const Int2& vertA{ verts[(triVertIdx + 1) % 3] };
+		const Int2& vertB{ verts[(triVertIdx + 2) % 3] };
+		setup.weightDdx[triVertIdx] = (vertA.y - vertB.y) * scale;
+		setup.weightDdy[triVertIdx] = (vertB.x - vertA.x) * scale;
+
+		// uv is divided by the depth, normal, tangent, viewDirection and bitangentSign by w
+		const size_t vertIdx{ vertIndices[triVertIdx] };
+		const float invDepth{ 1.f / mesh.positions_out.z[vertIdx] };
+		const float invW{ 1.f / mesh.positions_out.w[vertIdx] };
+		setup.invDepths[triVertIdx] = invDepth;
 
-		const ColorRGB normalSampleVecCol{ (2 * m_pNormalTexture->Sample(v.uv)) - ColorRGB{1,1,1} };
-		const Vector3 normalSampleVec{ normalSampleVecCol.r,normalSampleVecCol.g,normalSampleVecCol.b };
-		normal = tangentSpaceAxis.TransformVector(normalSampleVec);
+		float* pAttributes{ setup.attributes[triVertIdx] };
+		if (attributeMask & 0x3u)
+		{
+			const Vector2 uv{ mesh.GetUVOut(vertIdx) };
+			pAttributes[0] = uv.x * invDepth;
+			pAttributes[1] = uv.y * invDepth;
+		}
+		for (int streamIdx{ 0 }; streamIdx < 3; ++streamIdx)
+		{
+			if ((attributeMask & (0x1Cu << (streamIdx * 3))) == 0) continue;
+			pAttributes[2 + streamIdx * 3] = pStreams[streamIdx]->x[vertIdx] * invW;
+			pAttributes[3 + streamIdx * 3] = pStreams[streamIdx]->y[vertIdx] * invW;
+			pAttributes[4 + streamIdx * 3] = pStreams[streamIdx]->z[vertIdx] * invW;
+		}
+		if (attributeMask & 0x800u)
+		{
+			pAttributes[11] = mesh.GetBitangentSignOut(vertIdx) * invW;
+		}
 	}
+}
 
-	switch (m_RenderMode)
+dae::Renderer::UVGradients dae::Renderer::GetUVGradients(const TriangleSetup& setup)
+{
+	UVGradients gradients{};
+	for (int triVertIdx{ 0 }; triVertIdx < 3; ++triVertIdx)
 	{
-	case dae::Renderer::RenderMode::Default:
+		const Vector2 uv{ setup.attributes[triVertIdx][0], setup.attributes[triVertIdx][1] };
+		gradients.uvDdx += uv * setup.weightDdx[triVertIdx];
+		gradients.uvDdy += uv * setup.weightDdy[triVertIdx];
+		gradients.invDepthDdx += setup.invDepths[triVertIdx] * setup.weightDdx[triVertIdx];
+		gradients.invDepthDdy += setup.invDepths[triVertIdx] * setup.weightDdy[triVertIdx];
+	}
+	return gradients;
+}
+
+void dae::Renderer::GetTriangleBoundingBox(const Int2& vert0, const Int2& vert1, const Int2& vert2, Int2& topLeft, Int2& botRight) const
+{
+	// Boundingbox (bb) in fixed point
+	const int minX{ std::min(vert0.x, std::min(vert1.x, vert2.x)) };
+	const int minY{ std::min(vert0.y, std::min(vert1.y, vert2.y)) };
+	const int maxX{ std::max(vert0.x, std::max(vert1.x, vert2.x)) };
+	const int maxY{ std::max(vert0.y, std::max(vert1.y, vert2.y)) };
+
+	// Pixel p has its center at p + 0.5, so the first center >= min is ceil(min - 0.5)
+	// and the last center <= max is floor(max - 0.5), shifts round towards -infinity
+	const int halfPixel{ m_SubPixelScale / 2 };
+	const int subPixelMask{ m_SubPixelScale - 1 };
+	topLeft = { (minX - halfPixel + subPixelMask) >> m_SubPixelBits, (minY - halfPixel + subPixelMask) >> m_SubPixelBits };
+	botRight = { ((maxX - halfPixel) >> m_SubPixelBits) + 1, ((maxY - halfPixel) >> m_SubPixelBits) + 1 };
+
+	// Make sure the boundingbox is on the screen
+	topLeft.x = Clamp(topLeft.x, 0, m_Width);
+	topLeft.y = Clamp(topLeft.y, 0, m_Height);
+	botRight.x = Clamp(botRight.x, 0, m_Width);
+	botRight.y = Clamp(botRight.y, 0, m_Height);
+}
+
+int64_t dae::Renderer::GetSignedArea(const Int2& vert0, const Int2& vert1, const Int2& vert2)
+{
+	return static_cast<int64_t>(vert1.x - vert0.x) * (vert2.y - vert0.y) - static_cast<int64_t>(vert1.y - vert0.y) * (vert2.x - vert0.x);
+}
+
+template<typename SimdFloat, int... kernelIndices>
+void dae::Renderer::InitShadingKernels(std::integer_sequence<int, kernelIndices...>)
+{
+	((m_RenderMeshTriangleKernels[kernelIndices] = &Renderer::RenderMeshTriangle<SimdFloat, GetShadingKernel(kernelIndices), false>), ...);
+	m_RenderMeshTriangleDeferred = &Renderer::RenderMeshTriangle<SimdFloat, ShadingKernel{ RenderMode::Depth }, true>;
+	((m_ResolveTileKernels[kernelIndices] = &Renderer::ResolveTile<GetShadingKernel(kernelIndices)>), ...);
+}
+
+int dae::Renderer::GetShadingKernelIdx() const
+{
+	if (m_RenderMode == RenderMode::Depth)
+		return m_NrShadingKernels - 1;
+	return static_cast<int>(m_ShadingMode) * 4 + (m_EnableNormalMap ? 2 : 0) + (m_EnableFastSpecular ? 1 : 0);
+}
+
+template<typename SimdFloat, Renderer::ShadingKernel kernel, bool isDeferred>
+void dae::Renderer::RenderMeshTriangle(const Mesh& mesh, int triangleIdx, const Tile& tile)
+{
+	using SimdInt = typename SimdFloat::Int;
+
+	size_t vertIdx0, vertIdx1, vertIdx2;
+	GetTriangleIndices(mesh, triangleIdx, vertIdx0, vertIdx1, vertIdx2);
+
+	// Binning already culled, what is left facing away gets its winding flipped so the inside test passes
+	const bool isFlipped{ GetSignedArea(mesh.vertices_raster[vertIdx0], mesh.vertices_raster[vertIdx1], mesh.vertices_raster[vertIdx2]) < 0 };
+	if (isFlipped)
 	{
-		const float observedArea{ Vector3::DotClamp(normal.Normalized(), -m_GlobalLight.direction)};
-		finalColor = m_pDiffuseTexture->Sample(v.uv);
-		const ColorRGB lambert{ BRDF::Lambert(1.0f, m_pDiffuseTexture->Sample(v.uv)) };
-		const float specularVal{ m_SpecularShininess * m_pGlossinessTexture->Sample(v.uv).r };
-		const ColorRGB specular{ m_pSpecularTexture->Sample(v.uv) * BRDF::Phong(1.0f, specularVal, -m_GlobalLight.direction, v.viewDirection, normal) };
+		std::swap(vertIdx1, vertIdx2);
+	}
 
-		// += since finalColor is already a sample of the diffuse texture
-		switch (m_ShadingMode)
+	const Int2 vert0{ mesh.vertices_raster[vertIdx0] };
+	const Int2 vert1{ mesh.vertices_raster[vertIdx1] };
+	const Int2 vert2{ mesh.vertices_raster[vertIdx2] };
+
+	Int2 bbTopLeft, bbBotRight;
+	GetTriangleBoundingBox(vert0, vert1, vert2, bbTopLeft, bbBotRight);
+
+	// Only touch the pixels owned by this tile
+	const int startX{ std::max(bbTopLeft.x, tile.topLeft.x) };
+	const int endX{ std::min(bbBotRight.x, tile.botRight.x) };
+	const int startY{ std::max(bbTopLeft.y, tile.topLeft.y) };
+	const int endY{ std::min(bbBotRight.y, tile.botRight.y) };
+
+	// Edge functions, set up once per triangle, exact since everything is in fixed point
+	// edgeN is the cross product (pixel - vertA) x (vertA - vertB) of the edge opposite of vertN,
+	// which is linear in the pixel position: a * (x - vertA.x) + b * (y - vertA.y)
+	// Stepping one pixel right adds a * m_SubPixelScale, stepping one pixel down adds b * m_SubPixelScale
+	const Int2 edgeVerts[3][2]{ { vert1, vert2 }, { vert2, vert0 }, { vert0, vert1 } };
+	int edgeA[3], edgeB[3], edgeBias[3];
+	for (int edgeIdx{ 0 }; edgeIdx < 3; ++edgeIdx)
+	{
+		const Int2& vertA{ edgeVerts[edgeIdx][0] };
+		const Int2& vertB{ edgeVerts[edgeIdx][1] };
+		edgeA[edgeIdx] = vertA.y - vertB.y;
+		edgeB[edgeIdx] = vertB.x - vertA.x;
+
+		// Top-left fill rule: a pixel center exactly on an edge only belongs to the triangle if it is a left edge
+		// (inside is to the right) or a top edge (horizontal, inside is below), so shared edges are drawn exactly once
+		// Biasing the other edges by -1 turns the inside test into a sign test
+		const bool isTopLeft{ edgeA[edgeIdx] > 0 || (edgeA[edgeIdx] == 0 && edgeB[edgeIdx] > 0) };
+		edgeBias[edgeIdx] = isTopLeft ? 0 : -1;
+	}
+
+	// The three edge functions add up to the total triangle area
+	const int64_t totalTriangleArea{ GetSignedArea(vert0, vert1, vert2) };
+	// Nothing can pass the inside test
+	if (totalTriangleArea <= 0) return;
+	const float invTotalTriangleArea{ 1 / static_cast<float>(totalTriangleArea) };
+
+	// The interpolated depth never leaves the range of the vertex depths
+	const std::vector<float>& depths{ mesh.positions_out.z };
+	const float triangleMinDepth{ std::min(depths[vertIdx0], std::min(depths[vertIdx1], depths[vertIdx2])) };
+	const float triangleMaxDepth{ std::max(depths[vertIdx0], std::max(depths[vertIdx1], depths[vertIdx2])) };
+
+	// Reject the whole triangle if every block it touches is already closer
+	const int startBlockX{ startX / m_HiZBlockSize };
+	const int endBlockX{ (endX - 1) / m_HiZBlockSize };
+	const int startBlockY{ startY / m_HiZBlockSize };
+	const int endBlockY{ (endY - 1) / m_HiZBlockSize };
+	bool isOccluded{ true };
+	for (int blockY{ startBlockY }; blockY <= endBlockY && isOccluded; ++blockY)
+	{
+		for (int blockX{ startBlockX }; blockX <= endBlockX; ++blockX)
 		{
-		case dae::Renderer::ShadingMode::ObservedArea:
-			finalColor = ColorRGB{ observedArea, observedArea, observedArea };
-			break;
-		case dae::Renderer::ShadingMode::Diffuse:
-			finalColor += m_GlobalLight.intensity * observedArea * lambert;
-			break;
-		case dae::Renderer::ShadingMode::Specular:
-			finalColor += specular * observedArea;
-			break;
-		case dae::Renderer::ShadingMode::Combined:
-			finalColor += m_GlobalLight.intensity * observedArea * lambert + specular;
-			break;
+			if (triangleMinDepth <= GetHiZMaxDepth(m_HiZBlocks[blockX + blockY * m_NrHiZBlocksX], blockX, blockY))
+			{
+				isOccluded = false;
+				break;
+			}
 		}
+	}
+	if (isOccluded) return;
+
+	constexpr uint32_t attributeMask{ kernel.GetAttributeMask() };
+	const size_t vertIndices[3]{ vertIdx0, vertIdx1, vertIdx2 };
+	TriangleSetup setup{};
+	SetupTriangle(mesh, vertIndices, attributeMask, setup);
+	const float* const invDepths{ setup.invDepths };
+	const float (&attributes)[3][m_NrAttributes]{ setup.attributes };
 
+	const SimdFloat zero{ 0.f };
+	const SimdFloat one{ 1.f };
+	// Spans start on a multiple of their width, so a span never straddles two HiZ blocks
+	// and on an even pixel, so the columns of a quad are in the same span (or the same pair of spans when a span is 1 wide)
+	constexpr int spanAlignment{ std::max(SimdFloat::Width, 2) };
+	static_assert(m_HiZBlockSize % spanAlignment == 0 && m_TileSize % spanAlignment == 0);
+	const int alignedStartX{ startX - startX % spanAlignment };
+	const int alignedEndX{ endX + (spanAlignment - endX % spanAlignment) % spanAlignment };
+	// Quad rows start on an even row, so both rows are in the same HiZ block row
+	const int alignedStartY{ startY - startY % 2 };
+	const int fullLaneBits{ (1 << SimdFloat::Width) - 1 };
+
+	// Plane equations of the attributes the kernel uses, with the first pixel center of the first quad row as origin
+	// The weights change by a constant amount per pixel, see TriangleSetup
+	// The depth stays on the weights themselves, those are exact, so which triangle ends up in front doesn't depend on the kernel
+	const int originXFixed{ alignedStartX * m_SubPixelScale + m_SubPixelScale / 2 };
+	const int originYFixed{ alignedStartY * m_SubPixelScale + m_SubPixelScale / 2 };
+	float originWeights[3];
+	for (int edgeIdx{ 0 }; edgeIdx < 3; ++edgeIdx)
+	{
+		const Int2& vertA{ edgeVerts[edgeIdx][0] };
+		originWeights[edgeIdx] = (edgeA[edgeIdx] * (originXFixed - vertA.x) + edgeB[edgeIdx] * (originYFixed - vertA.y)) * invTotalTriangleArea;
 	}
-	break;
-	case dae::Renderer::RenderMode::Depth:
+	const auto getPlane = [&](float value0, float value1, float value2)
+	{
+		return AttributePlane{
+			originWeights[0] * value0 + originWeights[1] * value1 + originWeights[2] * value2,
+			setup.weightDdx[0] * value0 + setup.weightDdx[1] * value1 + setup.weightDdx[2] * value2,
+			setup.weightDdy[0] * value0 + setup.weightDdy[1] * value1 + setup.weightDdy[2] * value2 };
+	};
+	AttributePlane attributePlanes[m_NrAttributes]{};
+	for (int attributeIdx{ 0 }; attributeIdx < m_NrAttributes; ++attributeIdx)
+	{
+		if (attributeMask & (1u << attributeIdx))
+		{
+			attributePlanes[attributeIdx] = getPlane(attributes[0][attributeIdx], attributes[1][attributeIdx], attributes[2][attributeIdx]);
+		}
+	}
+	const SimdFloat laneXs{ SimdFloat::Ramp() };
+
+	// Offset of every lane to the first one of the span, and the step to the next span
+	SimdInt laneOffsets[3];
+	SimdInt spanStep[3];
+	const SimdInt edgeUnbias[3]{ -edgeBias[0], -edgeBias[1], -edgeBias[2] };
+	for (int edgeIdx{ 0 }; edgeIdx < 3; ++edgeIdx)
+	{
+		alignas(32) int offsets[SimdFloat::Width];
+		for (int lane{ 0 }; lane < SimdFloat::Width; ++lane)
+		{
+			offsets[lane] = lane * edgeA[edgeIdx] * m_SubPixelScale;
+		}
+		laneOffsets[edgeIdx] = SimdInt::Load(offsets);
+		spanStep[edgeIdx] = SimdInt{ edgeA[edgeIdx] * m_SubPixelScale * SimdFloat::Width };
+	}
+
+	alignas(32) float spanDepths[SimdFloat::Width];
+	// Both rows of a quad row, indexed by px - alignedStartX, helper pixels included
+	static_assert(m_TileSize <= 32, "The pixels of a row in a tile are tracked in 32 bit masks");
+	alignas(32) float rowDepths[2][m_TileSize];
+	alignas(32) float rowAttributes[2][m_NrAttributes][m_TileSize];
+
+	// For each pair of rows, the quads of the forward shading are 2x2 pixels
+	for (int quadY{ alignedStartY }; quadY < endY; quadY += 2)
+	{
+		// Evaluate at the pixel centers of the start of both rows, then step incrementally
+		const int startPxFixed{ alignedStartX * m_SubPixelScale + m_SubPixelScale / 2 };
+		const int pyFixed{ quadY * m_SubPixelScale + m_SubPixelScale / 2 };
+		HiZBlock* pBlockRow{ &m_HiZBlocks[(quadY / m_HiZBlockSize) * m_NrHiZBlocksX] };
+		int rowStarts[2][3];
+		for (int edgeIdx{ 0 }; edgeIdx < 3; ++edgeIdx)
+		{
+			rowStarts[0][edgeIdx] = edgeA[edgeIdx] * (startPxFixed - edgeVerts[edgeIdx][0].x) + edgeB[edgeIdx] * (pyFixed - edgeVerts[edgeIdx][0].y) + edgeBias[edgeIdx];
+			rowStarts[1][edgeIdx] = rowStarts[0][edgeIdx] + edgeB[edgeIdx] * m_SubPixelScale;
+		}
+		// A row outside of the triangle or the tile only has helper pixels
+		const bool isRowInside[2]{ quadY >= startY, quadY + 1 < endY };
+
+		// Coverage of both rows first, so it is known which pixels the quads need
+		uint32_t insideRowBits[2]{};
+		for (int row{ 0 }; row < 2; ++row)
+		{
+			if (!isRowInside[row]) continue;
+			SimdInt edges[3];
+			for (int edgeIdx{ 0 }; edgeIdx < 3; ++edgeIdx)
+			{
+				edges[edgeIdx] = SimdInt{ rowStarts[row][edgeIdx] } + laneOffsets[edgeIdx];
+			}
+			for (int px{ alignedStartX }; px < alignedEndX; px += SimdFloat::Width, edges[0] += spanStep[0], edges[1] += spanStep[1], edges[2] += spanStep[2])
+			{
+				// The (possibly outdated) max is never closer than the real one, so this stays conservative
+				if (triangleMinDepth > pBlockRow[px / m_HiZBlockSize].maxDepth) continue;
+
+				// Same test as Utils::IsInTriangle, inside means none of the edge functions is negative
+				// Lanes outside of [startX, endX) are masked out
+				int insideBits{ ~(edges[0] | edges[1] | edges[2]).GetSignBits() & fullLaneBits };
+				if (px < startX) insideBits &= fullLaneBits << (startX - px);
+				if (px + SimdFloat::Width > endX) insideBits &= fullLaneBits >> (px + SimdFloat::Width - endX);
+				insideRowBits[row] |= static_cast<uint32_t>(insideBits) << (px - alignedStartX);
+			}
+		}
+
+		uint32_t neededBits{ insideRowBits[0] | insideRowBits[1] };
+		if (!neededBits) continue;
+		// Every column of a quad with a covered pixel, the other column holds its helper pixels
+		// Only the uv derivatives need them
+		if constexpr (kernel.UsesUV() && !isDeferred)
+		{
+			neededBits |= ((neededBits & 0x55555555u) << 1) | ((neededBits & 0xAAAAAAAAu) >> 1);
+		}
+
+		uint32_t passedRowBits[2]{};
+		for (int px{ alignedStartX }; px < alignedEndX; px += SimdFloat::Width)
+		{
+			const int spanOffset{ px - alignedStartX };
+			if (((neededBits >> spanOffset) & fullLaneBits) == 0) continue;
+			HiZBlock& block{ pBlockRow[px / m_HiZBlockSize] };
+
+			const SimdFloat spanXs{ laneXs + SimdFloat{ static_cast<float>(spanOffset) } };
+
+			for (int row{ 0 }; row < 2; ++row)
+			{
+				// weights, the edge functions without the fill rule bias
+				SimdFloat weights[3];
+				for (int edgeIdx{ 0 }; edgeIdx < 3; ++edgeIdx)
+				{
+					const SimdInt edge{ SimdInt{ rowStarts[row][edgeIdx] + edgeA[edgeIdx] * m_SubPixelScale * spanOffset } + laneOffsets[edgeIdx] };
+					weights[edgeIdx] = SimdFloat{ edge + edgeUnbias[edgeIdx] } * invTotalTriangleArea;
+				}
+				const SimdFloat interpolatedDepth{ one / (weights[0] * invDepths[0] + weights[1] * invDepths[1] + weights[2] * invDepths[2]) };
+
+				const int pixelIdx{ px + (quadY + row) * m_Width };
+				int laneBits{ static_cast<int>(insideRowBits[row] >> spanOffset) & fullLaneBits };
+				if (laneBits)
+				{
+					typename SimdFloat::Mask depthPassed{ (interpolatedDepth >= zero) & (interpolatedDepth <= one) };
+					// Closer than everything in the block, no need to read the depth buffer
+					if (triangleMaxDepth >= block.minDepth)
+					{
+						// The depth buffer is padded, reading past the last pixel is fine
+						depthPassed = depthPassed & (interpolatedDepth <= SimdFloat::Load(m_pDepthBufferPixels + pixelIdx));
+					}
+					laneBits &= depthPassed.GetBits();
+				}
+				interpolatedDepth.Store(spanDepths);
+				if (laneBits)
+				{
+					block.isMaxDirty = true;
+					for (int depthBits{ laneBits }; depthBits; depthBits &= depthBits - 1)
+					{
+						const int lane{ std::countr_zero(static_cast<unsigned int>(depthBits)) };
+						m_pDepthBufferPixels[pixelIdx + lane] = spanDepths[lane];
+						block.minDepth = std::min(block.minDepth, spanDepths[lane]);
+					}
+				}
+
+				if constexpr (isDeferred)
+				{
+					// Only remember what is visible, shading happens in ResolveTile
+					alignas(32) float spanWeights1[SimdFloat::Width];
+					alignas(32) float spanWeights2[SimdFloat::Width];
+					// Stored in index buffer order, so undo the flip
+					(isFlipped ? weights[2] : weights[1]).Store(spanWeights1);
+					(isFlipped ? weights[1] : weights[2]).Store(spanWeights2);
+					while (laneBits)
+					{
+						const int lane{ std::countr_zero(static_cast<unsigned int>(laneBits)) };
+						laneBits &= laneBits - 1;
+						m_pVisibilityBuffer[pixelIdx + lane] = VisibilityPixel{ triangleIdx, m_CurrentMeshIdx, spanWeights1[lane], spanWeights2[lane] };
+					}
+				}
+				else
+				{
+					passedRowBits[row] |= static_cast<uint32_t>(laneBits) << spanOffset;
+
+					// Perspective correct interpolation of the attributes the kernel uses for the whole span at once, helper pixels too
+					const float rowY{ static_cast<float>(quadY + row - alignedStartY) };
+					const auto interpolate = [&](int attributeIdx)
+					{
+						const AttributePlane& plane{ attributePlanes[attributeIdx] };
+						return (SimdFloat{ plane.origin + plane.ddy * rowY } + SimdFloat{ plane.ddx } * spanXs) * interpolatedDepth;
+					};
+					const auto interpolateNormalized = [&](int firstAttributeIdx)
+					{
+						const SimdFloat x{ interpolate(firstAttributeIdx) };
+						const SimdFloat y{ interpolate(firstAttributeIdx + 1) };
+						const SimdFloat z{ interpolate(firstAttributeIdx + 2) };
+						const SimdFloat invLength{ one / SimdFloat::Sqrt(x * x + y * y + z * z) };
+						(x * invLength).Store(rowAttributes[row][firstAttributeIdx] + spanOffset);
+						(y * invLength).Store(rowAttributes[row][firstAttributeIdx + 1] + spanOffset);
+						(z * invLength).Store(rowAttributes[row][firstAttributeIdx + 2] + spanOffset);
+					};
+					interpolatedDepth.Store(rowDepths[row] + spanOffset);
+					if constexpr (kernel.UsesUV())
+					{
+						interpolate(0).Store(rowAttributes[row][0] + spanOffset);
+						interpolate(1).Store(rowAttributes[row][1] + spanOffset);
+					}
+					if constexpr (kernel.UsesNormal())
+					{
+						interpolateNormalized(2);
+					}
+					if constexpr (kernel.UsesTangent())
+					{
+						interpolateNormalized(5);
+						interpolate(11).Store(rowAttributes[row][11] + spanOffset);
+					}
+					if constexpr (kernel.UsesViewDirection())
+					{
+						interpolateNormalized(8);
+					}
+				}
+			}
+		}
+		if constexpr (!isDeferred)
+		{
+			const auto getPixel = [&](int row, int x)
+			{
+				const float depth{ rowDepths[row][x] };
+				const float (&pixelAttributes)[m_NrAttributes][m_TileSize]{ rowAttributes[row] };
+				Vertex_Out pixel{};
+				pixel.position = { static_cast<float>(alignedStartX + x),static_cast<float>(quadY + row), depth,depth };
+				if constexpr (kernel.UsesUV())
+					pixel.uv = { pixelAttributes[0][x], pixelAttributes[1][x] };
+				if constexpr (kernel.UsesNormal())
+					pixel.normal = { pixelAttributes[2][x], pixelAttributes[3][x], pixelAttributes[4][x] };
+				if constexpr (kernel.UsesTangent())
+				{
+					pixel.tangent = { pixelAttributes[5][x], pixelAttributes[6][x], pixelAttributes[7][x] };
+					pixel.bitangentSign = pixelAttributes[11][x];
+				}
+				if constexpr (kernel.UsesViewDirection())
+					pixel.viewDirection = { pixelAttributes[8][x], pixelAttributes[9][x], pixelAttributes[10][x] };
+				return pixel;
+			};
+
+			if constexpr (kernel.UsesUV())
+			{
+				// Shade every quad with a pixel that passed, in the order top left, top right, bottom left, bottom right
+				const uint32_t passedBits{ passedRowBits[0] | passedRowBits[1] };
+				for (uint32_t quadBits{ (passedBits | (passedBits >> 1)) & 0x55555555u }; quadBits; quadBits &= quadBits - 1)
+				{
+					const int column{ std::countr_zero(quadBits) };
+					Vertex_Out quad[4]{ getPixel(0, column), getPixel(0, column + 1), getPixel(1, column), getPixel(1, column + 1) };
+					const int coveredBits{ static_cast<int>(((passedRowBits[0] >> column) & 3) | (((passedRowBits[1] >> column) & 3) << 2)) };
+					ShadeQuad<kernel>(quad, coveredBits);
+				}
+			}
+			else
+			{
+				// Nothing to take derivatives of, so no quads either
+				for (int row{ 0 }; row < 2; ++row)
+				{
+					for (uint32_t passedBits{ passedRowBits[row] }; passedBits; passedBits &= passedBits - 1)
+					{
+						PixelShading<kernel>(getPixel(row, std::countr_zero(passedBits)));
+					}
+				}
+			}
+		}
+	}
+}
+
+template<Renderer::ShadingKernel kernel>
+void dae::Renderer::ShadeQuad(Vertex_Out (&quad)[4], int coveredBits)
+{
+	// Every pixel takes the difference along its own row and column of the quad
+	for (int quadPixelIdx{ 0 }; quadPixelIdx < 4; ++quadPixelIdx)
+	{
+		const Vector2& rowLeft{ quad[quadPixelIdx & 2].uv };
+		const Vector2& rowRight{ quad[(quadPixelIdx & 2) + 1].uv };
+		const Vector2& columnTop{ quad[quadPixelIdx & 1].uv };
+		const Vector2& columnBottom{ quad[(quadPixelIdx & 1) + 2].uv };
+		quad[quadPixelIdx].uvDdx = { rowRight.x - rowLeft.x, rowRight.y - rowLeft.y };
+		quad[quadPixelIdx].uvDdy = { columnBottom.x - columnTop.x, columnBottom.y - columnTop.y };
+	}
+
+	// Helper pixels are only there for the derivatives
+	while (coveredBits)
+	{
+		const int quadPixelIdx{ std::countr_zero(static_cast<unsigned int>(coveredBits)) };
+		coveredBits &= coveredBits - 1;
+		PixelShading<kernel>(quad[quadPixelIdx]);
+	}
+}
+
+template<Renderer::ShadingKernel kernel>
+void dae::Renderer::PixelShading(const Vertex_Out& v)
+{
+	ColorRGB finalColor{};
+
+	if constexpr (kernel.renderMode == RenderMode::Depth)
 	{
 		const float depthCol{ Remap(v.position.w,0.985f,1.f) };
 		finalColor = { depthCol,depthCol,depthCol };
 	}
-	break;
-	case dae::Renderer::RenderMode::END:
-		std::cout << "Something went terribly wrong, Rendermode is END\n";
-		break;
+	else
+	{
+		// Every map in one go, the observed area only needs it for the normal
+		MaterialSample material{};
+		if constexpr (kernel.shadingMode != ShadingMode::ObservedArea || kernel.isNormalMapped)
+		{
+			material = m_pMaterial->Sample(v.uv, v.uvDdx, v.uvDdy);
+		}
+
+		Vector3 normal{ v.normal };
+		if constexpr (kernel.isNormalMapped)
+		{
+			// Mirrored uvs flip the binormal, only the sign of the interpolated value matters
+			const Vector3 binormal = Vector3::Cross(v.normal, v.tangent) * (v.bitangentSign < 0.f ? -1.f : 1.f);
+			const Matrix tangentSpaceAxis = Matrix{ v.tangent,binormal,v.normal,Vector3::Zero };
+			normal = tangentSpaceAxis.TransformVector(material.normal);
+		}
+
+		const float observedArea{ Vector3::DotClamp(normal.Normalized(), -m_GlobalLight.direction)};
+		const auto getDiffuse = [&]
+		{
+			return m_GlobalLight.intensity * observedArea * BRDF::Lambert(1.0f, material.diffuse);
+		};
+		const auto getSpecular = [&]
+		{
+			const float specularVal{ m_SpecularShininess * material.gloss };
+			return material.specular * BRDF::Phong<kernel.isFastSpecular>(1.0f, specularVal, -m_GlobalLight.direction, v.viewDirection, normal);
+		};
+
+		// += since finalColor is already a sample of the diffuse texture
+		if constexpr (kernel.shadingMode == ShadingMode::ObservedArea)
+		{
+			finalColor = ColorRGB{ observedArea, observedArea, observedArea };
+		}
+		else if constexpr (kernel.shadingMode == ShadingMode::Diffuse)
+		{
+			finalColor = material.diffuse;
+			finalColor += getDiffuse();
+		}
+		else if constexpr (kernel.shadingMode == ShadingMode::Specular)
+		{
+			finalColor = material.diffuse;
+			finalColor += getSpecular() * observedArea;
+		}
+		else
+		{
+			finalColor = material.diffuse;
+			finalColor += getDiffuse() + getSpecular();
+		}
 	}
 
 	//Update Color in Buffer
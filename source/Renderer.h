@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "Camera.h"
@@ -11,11 +12,12 @@ struct SDL_Surface;
 
 namespace dae
 {
-	class Texture;
+	class Material;
 	struct Mesh;
 	struct Vertex;
 	class Timer;
 	class Scene;
+	class ThreadPool;
 
 	class Renderer final
 	{
@@ -43,6 +45,11 @@ namespace dae
 			m_ShadingMode = static_cast<ShadingMode>((static_cast<int>(m_ShadingMode) + 1) % (static_cast<int>(ShadingMode::END)));
 		}
 
+		inline void NextCullMode()
+		{
+			m_CullMode = static_cast<CullMode>((static_cast<int>(m_CullMode) + 1) % (static_cast<int>(CullMode::END)));
+		}
+
 	private:
 		enum class RenderMode
 		{
@@ -57,6 +64,125 @@ namespace dae
 			END
 		};
 
+		// Which side of a triangle is skipped, decided once per triangle from its signed area
+		enum class CullMode
+		{
+			None, Back, Front, END
+		};
+
+		// Screen region that is rasterized by one thread at a time
+		// It owns its part of the back and depth buffer, so no locking is needed
+		struct Tile
+		{
+			Int2 topLeft{};
+			Int2 botRight{};
+			// Range of m_BinnedTriangles with every triangle overlapping this tile, in draw order
+			int firstBinnedIdx{};
+			int nrBinnedTriangles{};
+		};
+		// Tiles overlapped by a triangle, inclusive, empty if the triangle is not drawn
+		struct TileRange
+		{
+			Int2 first{};
+			Int2 last{ -1, -1 };
+		};
+		static constexpr int m_TileSize{ 32 };
+
+		// Depth range of an 8x8 block of the depth buffer, used to skip hidden triangles and spans
+		// Blocks never straddle tiles, so they are owned by the same thread as their pixels
+		struct HiZBlock
+		{
+			float minDepth{ FLT_MAX };
+			// Can be larger than the real max, only recalculated when isMaxDirty and a triangle asks for it
+			float maxDepth{ FLT_MAX };
+			bool isMaxDirty{ false };
+		};
+		static constexpr int m_HiZBlockSize{ 8 };
+
+		// What ended up in front at a pixel, written by the rasterizer when deferred shading is enabled
+		// The depth itself stays in the depth buffer
+		struct VisibilityPixel
+		{
+			// See GetTriangleIndices, -1 if the pixel is empty
+			int triangleIdx{ -1 };
+			int meshIdx{};
+			// Screen space barycentric weights, weight0 is 1 - weight1 - weight2
+			float weight1{};
+			float weight2{};
+		};
+
+		// Change of uv / depth and 1 / depth over one pixel to the right and one pixel down, constant over a triangle
+		// The change of uv itself follows from the quotient rule: (uvDdx - uv * invDepthDdx) * depth
+		struct UVGradients
+		{
+			Vector2 uvDdx{};
+			Vector2 uvDdy{};
+			float invDepthDdx{};
+			float invDepthDdy{};
+		};
+
+		// uv (2), normal, tangent and viewDirection (3 each) and bitangentSign, divided by depth or w
+		static constexpr int m_NrAttributes{ 12 };
+
+		// Everything about a triangle that is the same for all of its pixels, so the pixels only multiply and add
+		struct TriangleSetup
+		{
+			// 1 / depth of every vertex
+			float invDepths[3]{};
+			// Every attribute of every vertex divided by depth (uv) or w (the others), ready for perspective correct interpolation
+			float attributes[3][m_NrAttributes]{};
+			// Change of the weight of every vertex over one pixel to the right and one pixel down
+			float weightDdx[3]{};
+			float weightDdy[3]{};
+		};
+
+		// Something linear in screen space over a triangle: origin + ddx * x + ddy * y, with x and y the pixels from the origin
+		struct AttributePlane
+		{
+			float origin{};
+			float ddx{};
+			float ddy{};
+		};
+
+		// Everything the shading depends on besides the pixel itself, fixed for a whole frame
+		// Every combination gets its own instance of the rasterizer and resolve loops, so PixelShading has no branches on it
+		// and only does the work the mode shows
+		struct ShadingKernel
+		{
+			RenderMode renderMode{ RenderMode::Default };
+			ShadingMode shadingMode{ ShadingMode::Combined };
+			bool isNormalMapped{ false };
+			bool isFastSpecular{ false };
+
+			// The attributes PixelShading reads, the others are never interpolated
+			constexpr bool UsesUV() const { return renderMode == RenderMode::Default && (shadingMode != ShadingMode::ObservedArea || isNormalMapped); }
+			constexpr bool UsesNormal() const { return renderMode == RenderMode::Default; }
+			// And the bitangent sign
+			constexpr bool UsesTangent() const { return renderMode == RenderMode::Default && isNormalMapped; }
+			constexpr bool UsesViewDirection() const { return renderMode == RenderMode::Default && (shadingMode == ShadingMode::Specular || shadingMode == ShadingMode::Combined); }
+			// A bit per attribute, see m_NrAttributes
+			constexpr uint32_t GetAttributeMask() const
+			{
+				return (UsesUV() ? 0x3u : 0u) | (UsesNormal() ? 0x1Cu : 0u) | (UsesTangent() ? 0x8E0u : 0u) | (UsesViewDirection() ? 0x700u : 0u);
+			}
+		};
+		// Every shading mode with and without normal map and fast specular, depth last
+		static constexpr int m_NrShadingKernels{ static_cast<int>(ShadingMode::END) * 4 + 1 };
+		// Inverse of GetShadingKernelIdx, the flags a mode doesn't use stay false so those combinations share an instance
+		static constexpr ShadingKernel GetShadingKernel(int kernelIdx)
+		{
+			if (kernelIdx == m_NrShadingKernels - 1)
+				return { RenderMode::Depth };
+			const ShadingMode shadingMode{ static_cast<ShadingMode>(kernelIdx / 4) };
+			const bool hasSpecular{ shadingMode == ShadingMode::Specular || shadingMode == ShadingMode::Combined };
+			return { RenderMode::Default, shadingMode, (kernelIdx & 2) != 0, hasSpecular && (kernelIdx & 1) != 0 };
+		}
+
+		// Raster positions are snapped to 28.4 fixed point, so edge functions are exact integers
+		// With the guard band of the camera the edge functions of on-screen pixels fit in 32 bits
+		static constexpr int m_SubPixelBits{ 4 };
+		static constexpr int m_SubPixelScale{ 1 << m_SubPixelBits };
+
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pFrontBuffer{ nullptr };
@@ -64,19 +190,37 @@ namespace dae
 		uint32_t* m_pBackBufferPixels{};
 
 		float* m_pDepthBufferPixels{};
+		VisibilityPixel* m_pVisibilityBuffer{};
 
 		Camera m_Camera{};
 
 		int m_Width{};
 		int m_Height{};
 
-		Texture* m_pDiffuseTexture;
-		Texture* m_pSpecularTexture;
-		Texture* m_pGlossinessTexture;
-		Texture* m_pNormalTexture;
+		ThreadPool* m_pThreadPool{ nullptr };
+		std::vector<Tile> m_Tiles{};
+		// The triangles of every tile back to back, see Tile
+		std::vector<int> m_BinnedTriangles{};
+		// TileRange of every triangle of the current mesh
+		std::vector<TileRange> m_TriangleTileRanges{};
+		int m_NrTilesX{};
+		int m_NrTilesY{};
+		uint32_t m_ClearColor{};
+
+		// One bit per Camera::ClipPlane every vertex of the current mesh is outside of
+		std::vector<uint8_t> m_ClipCodes{};
+
+		std::vector<HiZBlock> m_HiZBlocks{};
+		int m_NrHiZBlocksX{};
+
+		Material* m_pMaterial;
 		Mesh* m_pMesh;
+		// Everything that gets rendered, their index is the meshIdx of the visibility buffer
+		// The post-transform buffers of a mesh live in the mesh itself and are reused every frame
+		std::vector<Mesh*> m_pMeshes{};
 		RenderMode m_RenderMode{ RenderMode::Default };
 		ShadingMode m_ShadingMode{ ShadingMode::Combined };
+		CullMode m_CullMode{ CullMode::Back };
 
 		const DirectionalLight m_GlobalLight{ Vector3{ .577f,-.557f,.577f }.Normalized() , 7.f};
 		const float m_SpecularShininess{ 25.0f };
@@ -84,6 +228,12 @@ namespace dae
 
 		bool m_EnableRotating{ true };
 		bool m_EnableNormalMap{ true };
+		// Shade every pixel once after all triangles are rasterized, instead of every fragment
+		bool m_EnableDeferredShading{ false };
+		// Specular through FastPow instead of powf, off to compare the two in image diffs
+		bool m_EnableFastSpecular{ true };
+		// Mesh that is being rasterized, stored in the visibility buffer
+		int m_CurrentMeshIdx{};
 		// Toggle depth
 		bool m_F4Held{ false };
 		// Toggle rotation
@@ -92,9 +242,28 @@ namespace dae
 		bool m_F6Held{ false };
 		// Cycle shading mode
 		bool m_F7Held{ false };
+		// Toggle deferred shading
+		bool m_F8Held{ false };
+		// Cycle cull mode
+		bool m_F9Held{ false };
+		// Toggle fast specular
+		bool m_F10Held{ false };
 
-		//Function that transforms the vertices from the mesh from World space to Screen space
+		//Function that transforms the vertices from the mesh from World space to NDC and raster space
 		void VertexTransformationFunction(Mesh& mesh);
+		// Fills the post-transform streams, the raster positions and clip codes of the vertices in [firstVertIdx, endVertIdx)
+		// SimdFloat::Width vertices at a time, the leftovers one by one
+		template<typename SimdFloat>
+		void TransformVertices(Mesh& mesh, const Matrix& worldViewProjectionMatrix, size_t firstVertIdx, size_t endVertIdx);
+		// Instance of TransformVertices for the widest SIMD width the CPU supports
+		using TransformVerticesFunction = void (Renderer::*)(Mesh&, const Matrix&, size_t, size_t);
+		TransformVerticesFunction m_pTransformVertices{ nullptr };
+		// Clips the triangles that cross the near/far plane or leave the guard band against them
+		// The new vertices are appended to the post-transform streams, perspective divided
+		void ClipMeshTriangles(Mesh& mesh);
+		// NDC --> Screenspace, snapped to the subpixel grid
+		Int2 GetRasterPosition(const Vector4& ndcPosition) const;
+		static Vertex_Out LerpVertex(const Vertex_Out& v0, const Vertex_Out& v1, float t);
 
 		// SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100 ));
 		inline void ClearBackground(){ SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100)); } const
@@ -102,8 +271,57 @@ namespace dae
 		// std::fill_n(m_pDepthBufferPixels, (m_Width * m_Height), FLT_MAX);
 		inline void ResetDepthBuffer() { std::fill_n(m_pDepthBufferPixels, (m_Width * m_Height), FLT_MAX); }
 
-		void RenderMeshTriangle(const Mesh& mesh, const std::vector<Vector2>& vertices_raster, int currentVertexIdx, bool swapVertices);
+		// Clears the back, depth and visibility buffer, but only the part owned by the tile
+		void ClearTile(const Tile& tile);
+		// Recalculates the max depth of the block if pixels of it were written since
+		float GetHiZMaxDepth(HiZBlock& block, int blockX, int blockY) const;
+		// Sorts the triangles of the mesh into the tiles their boundingbox overlaps
+		void BinMeshTriangles(const Mesh& mesh);
+		void RenderTile(const Mesh& mesh, const Tile& tile);
+		// Shades every pixel of the tile that is covered according to the visibility buffer
+		template<ShadingKernel kernel>
+		void ResolveTile(const Tile& tile);
+		using ResolveTileFunction = void (Renderer::*)(const Tile&);
+		ResolveTileFunction m_pResolveTile{ nullptr };
+		// Triangles of the mesh itself, not counting the clipped ones
+		int GetNrMeshTriangles(const Mesh& mesh) const;
+		// Triangles past GetNrMeshTriangles come from Mesh::clippedIndices
+		// Takes the strip winding into account
+		void GetTriangleIndices(const Mesh& mesh, int triangleIdx, size_t& vertIdx0, size_t& vertIdx1, size_t& vertIdx2) const;
+		// Only the attributes in attributeMask are filled in, see ShadingKernel::GetAttributeMask
+		// The vertices are taken in the order of vertIndices, either winding works
+		void SetupTriangle(const Mesh& mesh, const size_t vertIndices[3], uint32_t attributeMask, TriangleSetup& setup) const;
+		static UVGradients GetUVGradients(const TriangleSetup& setup);
+		// The pixels whose center lies in the fixed point boundingbox, the bottom right is exclusive
+		void GetTriangleBoundingBox(const Int2& vert0, const Int2& vert1, const Int2& vert2, Int2& topLeft, Int2& botRight) const;
+		// Twice the area in fixed point, positive if the triangle faces the camera
+		static int64_t GetSignedArea(const Int2& vert0, const Int2& vert1, const Int2& vert2);
+
+		// Rasterizes SimdFloat::Width pixels of a row at once, two rows at a time
+		// The shading is done per 2x2 quad, deferred only writes the visibility buffer
+		template<typename SimdFloat, ShadingKernel kernel, bool isDeferred>
+		void RenderMeshTriangle(const Mesh& mesh, int triangleIdx, const Tile& tile);
+		// Instance of RenderMeshTriangle for the widest SIMD width the CPU supports and the shading kernel of this frame
+		// Or the deferred one, which doesn't depend on the kernel
+		using RenderMeshTriangleFunction = void (Renderer::*)(const Mesh&, int, const Tile&);
+		RenderMeshTriangleFunction m_pRenderMeshTriangle{ nullptr };
+		// Every shading kernel, see GetShadingKernelIdx
+		RenderMeshTriangleFunction m_RenderMeshTriangleKernels[m_NrShadingKernels]{};
+		// The depth kernel, so no attributes are set up, ResolveTile interpolates them
+		RenderMeshTriangleFunction m_RenderMeshTriangleDeferred{ nullptr };
+		ResolveTileFunction m_ResolveTileKernels[m_NrShadingKernels]{};
+		// Fills the kernel tables with the instances for SimdFloat
+		template<typename SimdFloat, int... kernelIndices>
+		void InitShadingKernels(std::integer_sequence<int, kernelIndices...>);
+		// Index of the kernel for the current modes and toggles
+		int GetShadingKernelIdx() const;
 
+		// Pixels in the order top left, top right, bottom left, bottom right
+		// Fills the uv derivatives from the differences between the pixels and shades the pixels in coveredBits
+		// The others are helper pixels, interpolated outside of the triangle just for the derivatives
+		template<ShadingKernel kernel>
+		void ShadeQuad(Vertex_Out (&quad)[4], int coveredBits);
+		template<ShadingKernel kernel>
 		void PixelShading(const Vertex_Out& v);
 	};
 }
@@ -0,0 +1,206 @@
+#pragma once
+#include <cmath>
+#include <immintrin.h>
+
+// Thin wrappers around 1, 4 (SSE) and 8 (AVX) floats and ints, so the rasterizer can be written once
+// and instantiated for every width. Only use SimdFloat8/SimdInt8 when the CPU supports it (SDL_HasAVX2).
+
+namespace dae
+{
+#pragma region Scalar
+	struct SimdMask1
+	{
+		bool value{};
+
+		SimdMask1 operator&(const SimdMask1& m) const { return { value && m.value }; }
+		// One bit per lane
+		int GetBits() const { return value; }
+	};
+
+	struct SimdInt1
+	{
+		int value{};
+
+		SimdInt1() = default;
+		SimdInt1(int v) : value{ v } {}
+
+		static SimdInt1 Load(const int* pData) { return { *pData }; }
+
+		SimdInt1 operator+(const SimdInt1& i) const { return { value + i.value }; }
+		SimdInt1 operator|(const SimdInt1& i) const { return { value | i.value }; }
+		SimdInt1& operator+=(const SimdInt1& i) { value += i.value; return *this; }
+
+		// a0 b0 a1 b1 ...
+		static void StoreInterleaved(int* pData, const SimdInt1& a, const SimdInt1& b) { pData[0] = a.value; pData[1] = b.value; }
+
+		// One bit per negative lane
+		int GetSignBits() const { return value < 0; }
+	};
+
+	struct SimdFloat1
+	{
+		static constexpr int Width{ 1 };
+		using Mask = SimdMask1;
+		using Int = SimdInt1;
+
+		float value{};
+
+		SimdFloat1() = default;
+		SimdFloat1(float v) : value{ v } {}
+		explicit SimdFloat1(const SimdInt1& i) : value{ static_cast<float>(i.value) } {}
+
+		// 0, 1, 2, ... one value per lane
+		static SimdFloat1 Ramp() { return { 0.f }; }
+		static SimdFloat1 Load(const float* pData) { return { *pData }; }
+		void Store(float* pData) const { *pData = value; }
+
+		SimdFloat1 operator+(const SimdFloat1& f) const { return { value + f.value }; }
+		SimdFloat1 operator-(const SimdFloat1& f) const { return { value - f.value }; }
+		SimdFloat1 operator*(const SimdFloat1& f) const { return { value * f.value }; }
+		SimdFloat1 operator/(const SimdFloat1& f) const { return { value / f.value }; }
+		SimdFloat1& operator+=(const SimdFloat1& f) { value += f.value; return *this; }
+
+		Mask operator>=(const SimdFloat1& f) const { return { value >= f.value }; }
+		Mask operator<=(const SimdFloat1& f) const { return { value <= f.value }; }
+		Mask operator<(const SimdFloat1& f) const { return { value < f.value }; }
+
+		static SimdFloat1 Sqrt(const SimdFloat1& f) { return { sqrtf(f.value) }; }
+
+		// Rounds to nearest, ties to even
+		Int RoundToInt() const { return { static_cast<int>(lrintf(value)) }; }
+	};
+#pragma endregion
+
+#pragma region SSE
+	struct SimdMask4
+	{
+		__m128 value{};
+
+		SimdMask4 operator&(const SimdMask4& m) const { return { _mm_and_ps(value, m.value) }; }
+		int GetBits() const { return _mm_movemask_ps(value); }
+	};
+
+	struct SimdInt4
+	{
+		__m128i value{};
+
+		SimdInt4() = default;
+		SimdInt4(__m128i v) : value{ v } {}
+		SimdInt4(int v) : value{ _mm_set1_epi32(v) } {}
+
+		static SimdInt4 Load(const int* pData) { return { _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData)) }; }
+
+		SimdInt4 operator+(const SimdInt4& i) const { return { _mm_add_epi32(value, i.value) }; }
+		SimdInt4 operator|(const SimdInt4& i) const { return { _mm_or_si128(value, i.value) }; }
+		SimdInt4& operator+=(const SimdInt4& i) { value = _mm_add_epi32(value, i.value); return *this; }
+
+		static void StoreInterleaved(int* pData, const SimdInt4& a, const SimdInt4& b)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pData), _mm_unpacklo_epi32(a.value, b.value));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pData + 4), _mm_unpackhi_epi32(a.value, b.value));
+		}
+
+		int GetSignBits() const { return _mm_movemask_ps(_mm_castsi128_ps(value)); }
+	};
+
+	struct SimdFloat4
+	{
+		static constexpr int Width{ 4 };
+		using Mask = SimdMask4;
+		using Int = SimdInt4;
+
+		__m128 value{};
+
+		SimdFloat4() = default;
+		SimdFloat4(__m128 v) : value{ v } {}
+		SimdFloat4(float v) : value{ _mm_set1_ps(v) } {}
+		explicit SimdFloat4(const SimdInt4& i) : value{ _mm_cvtepi32_ps(i.value) } {}
+
+		static SimdFloat4 Ramp() { return { _mm_setr_ps(0.f, 1.f, 2.f, 3.f) }; }
+		static SimdFloat4 Load(const float* pData) { return { _mm_loadu_ps(pData) }; }
+		void Store(float* pData) const { _mm_storeu_ps(pData, value); }
+
+		SimdFloat4 operator+(const SimdFloat4& f) const { return { _mm_add_ps(value, f.value) }; }
+		SimdFloat4 operator-(const SimdFloat4& f) const { return { _mm_sub_ps(value, f.value) }; }
+		SimdFloat4 operator*(const SimdFloat4& f) const { return { _mm_mul_ps(value, f.value) }; }
+		SimdFloat4 operator/(const SimdFloat4& f) const { return { _mm_div_ps(value, f.value) }; }
+		SimdFloat4& operator+=(const SimdFloat4& f) { value = _mm_add_ps(value, f.value); return *this; }
+
+		Mask operator>=(const SimdFloat4& f) const { return { _mm_cmpge_ps(value, f.value) }; }
+		Mask operator<=(const SimdFloat4& f) const { return { _mm_cmple_ps(value, f.value) }; }
+		Mask operator<(const SimdFloat4& f) const { return { _mm_cmplt_ps(value, f.value) }; }
+
+		static SimdFloat4 Sqrt(const SimdFloat4& f) { return { _mm_sqrt_ps(f.value) }; }
+
+		Int RoundToInt() const { return { _mm_cvtps_epi32(value) }; }
+	};
+#pragma endregion
+
+#pragma region AVX
+	struct SimdMask8
+	{
+		__m256 value{};
+
+		SimdMask8 operator&(const SimdMask8& m) const { return { _mm256_and_ps(value, m.value) }; }
+		int GetBits() const { return _mm256_movemask_ps(value); }
+	};
+
+	struct SimdInt8
+	{
+		__m256i value{};
+
+		SimdInt8() = default;
+		SimdInt8(__m256i v) : value{ v } {}
+		SimdInt8(int v) : value{ _mm256_set1_epi32(v) } {}
+
+		static SimdInt8 Load(const int* pData) { return { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData)) }; }
+
+		SimdInt8 operator+(const SimdInt8& i) const { return { _mm256_add_epi32(value, i.value) }; }
+		SimdInt8 operator|(const SimdInt8& i) const { return { _mm256_or_si256(value, i.value) }; }
+		SimdInt8& operator+=(const SimdInt8& i) { value = _mm256_add_epi32(value, i.value); return *this; }
+
+		static void StoreInterleaved(int* pData, const SimdInt8& a, const SimdInt8& b)
+		{
+			// The unpacks work per 128 bit half, so the halves still have to be put in order
+			const __m256i low{ _mm256_unpacklo_epi32(a.value, b.value) };
+			const __m256i high{ _mm256_unpackhi_epi32(a.value, b.value) };
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pData), _mm256_permute2x128_si256(low, high, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pData + 8), _mm256_permute2x128_si256(low, high, 0x31));
+		}
+
+		int GetSignBits() const { return _mm256_movemask_ps(_mm256_castsi256_ps(value)); }
+	};
+
+	struct SimdFloat8
+	{
+		static constexpr int Width{ 8 };
+		using Mask = SimdMask8;
+		using Int = SimdInt8;
+
+		__m256 value{};
+
+		SimdFloat8() = default;
+		SimdFloat8(__m256 v) : value{ v } {}
+		SimdFloat8(float v) : value{ _mm256_set1_ps(v) } {}
+		explicit SimdFloat8(const SimdInt8& i) : value{ _mm256_cvtepi32_ps(i.value) } {}
+
+		static SimdFloat8 Ramp() { return { _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) }; }
+		static SimdFloat8 Load(const float* pData) { return { _mm256_loadu_ps(pData) }; }
+		void Store(float* pData) const { _mm256_storeu_ps(pData, value); }
+
+		SimdFloat8 operator+(const SimdFloat8& f) const { return { _mm256_add_ps(value, f.value) }; }
+		SimdFloat8 operator-(const SimdFloat8& f) const { return { _mm256_sub_ps(value, f.value) }; }
+		SimdFloat8 operator*(const SimdFloat8& f) const { return { _mm256_mul_ps(value, f.value) }; }
+		SimdFloat8 operator/(const SimdFloat8& f) const { return { _mm256_div_ps(value, f.value) }; }
+		SimdFloat8& operator+=(const SimdFloat8& f) { value = _mm256_add_ps(value, f.value); return *this; }
+
+		Mask operator>=(const SimdFloat8& f) const { return { _mm256_cmp_ps(value, f.value, _CMP_GE_OQ) }; }
+		Mask operator<=(const SimdFloat8& f) const { return { _mm256_cmp_ps(value, f.value, _CMP_LE_OQ) }; }
+		Mask operator<(const SimdFloat8& f) const { return { _mm256_cmp_ps(value, f.value, _CMP_LT_OQ) }; }
+
+		static SimdFloat8 Sqrt(const SimdFloat8& f) { return { _mm256_sqrt_ps(f.value) }; }
+
+		Int RoundToInt() const { return { _mm256_cvtps_epi32(value) }; }
+	};
+#pragma endregion
+}
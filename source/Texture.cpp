@@ -1,42 +1,275 @@
 #include "Texture.h"
 #include "Vector2.h"
 #include <SDL_image.h>
+#include <algorithm>
+#include <bit>
+#include <cassert>
 
 namespace dae
 {
-	Texture::Texture(SDL_Surface* pSurface) :
-		m_pSurface{ pSurface },
-		m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+	namespace
 	{
+		// Puts a zero bit in front of each of the lower 16 bits: abcd --> 0a0b0c0d
+		uint32_t SpreadBits(uint32_t value)
+		{
+			value &= 0xFFFF;
+			value = (value | (value << 8)) & 0x00FF00FF;
+			value = (value | (value << 4)) & 0x0F0F0F0F;
+			value = (value | (value << 2)) & 0x33333333;
+			value = (value | (value << 1)) & 0x55555555;
+			return value;
+		}
+
+		// Row-major RGBA8 pixels of an image, see Texture::m_ChannelShifts
+		bool LoadPixels(const std::string& path, std::vector<uint32_t>& pixels, int& width, int& height)
+		{
+			SDL_Surface* pSurface{ IMG_Load(path.c_str()) };
+			if (!pSurface)
+				return false;
+			// Bytes r, g, b, a in memory whatever the source format was, palettes and 24 bit images included
+			SDL_Surface* pConverted{ SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+			SDL_FreeSurface(pSurface);
+			if (!pConverted)
+				return false;
+
+			width = pConverted->w;
+			height = pConverted->h;
+			pixels.resize(static_cast<size_t>(width) * height);
+			for (int y{ 0 }; y < height; ++y)
+			{
+				const uint8_t* pRow{ static_cast<const uint8_t*>(pConverted->pixels) + static_cast<size_t>(y) * pConverted->pitch };
+				for (int x{ 0 }; x < width; ++x)
+				{
+					const uint8_t* pPixel{ pRow + x * 4 };
+					pixels[x + static_cast<size_t>(y) * width] = pPixel[0] | (pPixel[1] << 8) | (pPixel[2] << 16) | (static_cast<uint32_t>(pPixel[3]) << 24);
+				}
+			}
+			SDL_FreeSurface(pConverted);
+			return true;
+		}
 	}
 
-	Texture::~Texture()
+	Texture::Texture(const std::vector<uint32_t>& pixels, int width, int height, int nrLayers) :
+		m_NrLayers{ nrLayers }
 	{
-		if (m_pSurface)
+		// Row-major copies of every level first, the box filter works on those
+		std::vector<std::vector<uint32_t>> linearLevels{ pixels };
+		std::vector<MipLevel> levels{ { width, height } };
+
+		// Every level is half the size of the one before, down to 1x1
+		while (levels.back().width > 1 || levels.back().height > 1)
+		{
+			const MipLevel source{ levels.back() };
+			const std::vector<uint32_t>& sourcePixels{ linearLevels.back() };
+			const MipLevel level{ std::max(source.width / 2, 1), std::max(source.height / 2, 1) };
+			std::vector<uint32_t> levelPixels(static_cast<size_t>(level.width) * level.height * nrLayers);
+
+			// Average of the 2x2 source pixels under every pixel, a single row or column when the source is 1 wide or high
+			for (int y{ 0 }; y < level.height; ++y)
+			{
+				for (int x{ 0 }; x < level.width; ++x)
+				{
+					const int sourceX[2]{ std::min(x * 2, source.width - 1), std::min(x * 2 + 1, source.width - 1) };
+					const int sourceY[2]{ std::min(y * 2, source.height - 1), std::min(y * 2 + 1, source.height - 1) };
+					for (int layerIdx{ 0 }; layerIdx < nrLayers; ++layerIdx)
+					{
+						uint32_t pixel{};
+						for (const int shift : m_ChannelShifts)
+						{
+							uint32_t sum{};
+							for (int sampleIdx{ 0 }; sampleIdx < 4; ++sampleIdx)
+							{
+								sum += (sourcePixels[(sourceX[sampleIdx % 2] + sourceY[sampleIdx / 2] * source.width) * nrLayers + layerIdx] >> shift) & 0xFF;
+							}
+							// Rounded to nearest
+							pixel |= ((sum + 2) / 4) << shift;
+						}
+						levelPixels[(x + y * level.width) * nrLayers + layerIdx] = pixel;
+					}
+				}
+			}
+			levels.push_back(level);
+			linearLevels.push_back(std::move(levelPixels));
+		}
+
+		// Z-order over the largest power of two square that fits the level rounded up to powers of two
+		// Along the longer side these squares follow each other, levels that aren't powers of two leave some pixels unused
+		std::vector<int> squareBits(levels.size());
+		size_t nrPixels{};
+		size_t nrOffsets{};
+		for (size_t levelIdx{ 0 }; levelIdx < levels.size(); ++levelIdx)
+		{
+			const uint32_t paddedWidth{ std::bit_ceil(static_cast<uint32_t>(levels[levelIdx].width)) };
+			const uint32_t paddedHeight{ std::bit_ceil(static_cast<uint32_t>(levels[levelIdx].height)) };
+			squareBits[levelIdx] = std::countr_zero(std::min(paddedWidth, paddedHeight));
+			nrPixels += static_cast<size_t>(paddedWidth) * paddedHeight * nrLayers;
+			nrOffsets += static_cast<size_t>(levels[levelIdx].width) + levels[levelIdx].height;
+		}
+
+		// Sized once, so the levels can point into them
+		m_Pixels.resize(nrPixels);
+		m_Offsets.resize(nrOffsets);
+		uint32_t* pPixels{ m_Pixels.data() };
+		uint32_t* pOffsets{ m_Offsets.data() };
+		for (size_t levelIdx{ 0 }; levelIdx < levels.size(); ++levelIdx)
 		{
-			SDL_FreeSurface(m_pSurface);
-			m_pSurface = nullptr;
+			MipLevel& level{ levels[levelIdx] };
+			uint32_t* pOffsetsX{ pOffsets };
+			uint32_t* pOffsetsY{ pOffsets + level.width };
+			// The bits of x and y never overlap, so adding them interleaves them, and that still holds once both are scaled by the record size
+			const int bits{ squareBits[levelIdx] };
+			const uint32_t squareMask{ (1u << bits) - 1 };
+			for (int x{ 0 }; x < level.width; ++x)
+			{
+				pOffsetsX[x] = (SpreadBits(x & squareMask) | ((x >> bits) << (2 * bits))) * nrLayers;
+			}
+			for (int y{ 0 }; y < level.height; ++y)
+			{
+				pOffsetsY[y] = ((SpreadBits(y & squareMask) << 1) | ((y >> bits) << (2 * bits))) * nrLayers;
+			}
+
+			const std::vector<uint32_t>& linearPixels{ linearLevels[levelIdx] };
+			for (int y{ 0 }; y < level.height; ++y)
+			{
+				for (int x{ 0 }; x < level.width; ++x)
+				{
+					const uint32_t* pSource{ &linearPixels[(x + static_cast<size_t>(y) * level.width) * nrLayers] };
+					std::copy(pSource, pSource + nrLayers, pPixels + pOffsetsX[x] + pOffsetsY[y]);
+				}
+			}
+
+			level.pPixels = pPixels;
+			level.pOffsetsX = pOffsetsX;
+			level.pOffsetsY = pOffsetsY;
+			pPixels += static_cast<size_t>(std::bit_ceil(static_cast<uint32_t>(level.width))) * std::bit_ceil(static_cast<uint32_t>(level.height)) * nrLayers;
+			pOffsets += static_cast<size_t>(level.width) + level.height;
 		}
+		m_MipLevels = std::move(levels);
 	}
 
-	Texture* Texture::LoadFromFile(const std::string& path)
+	Texture* Texture::LoadLayers(const std::vector<LayerFiles>& layers)
 	{
-		return new Texture(IMG_Load(path.c_str()));
+		assert(!layers.empty() && layers.size() <= m_MaxNrLayers && "A texture has 1 up to m_MaxNrLayers layers");
+		if (layers.empty() || layers.size() > m_MaxNrLayers)
+			return nullptr;
+
+		const int nrLayers{ static_cast<int>(layers.size()) };
+		std::vector<uint32_t> pixels{}, layerPixels{}, alphaPixels{};
+		int width{}, height{};
+		for (int layerIdx{ 0 }; layerIdx < nrLayers; ++layerIdx)
+		{
+			const LayerFiles& files{ layers[layerIdx] };
+			int layerWidth{}, layerHeight{};
+			if (!LoadPixels(files.colorPath, layerPixels, layerWidth, layerHeight))
+				return nullptr;
+			if (layerIdx == 0)
+			{
+				width = layerWidth;
+				height = layerHeight;
+				pixels.resize(layerPixels.size() * nrLayers);
+			}
+			assert(layerWidth == width && layerHeight == height && "Every image of a texture needs to be the same size");
+			if (layerWidth != width || layerHeight != height)
+				return nullptr;
+
+			if (!files.alphaPath.empty())
+			{
+				int alphaWidth{}, alphaHeight{};
+				if (!LoadPixels(files.alphaPath, alphaPixels, alphaWidth, alphaHeight))
+					return nullptr;
+				assert(alphaWidth == width && alphaHeight == height && "Every image of a texture needs to be the same size");
+				if (alphaWidth != width || alphaHeight != height)
+					return nullptr;
+
+				constexpr uint32_t colorMask{ ~(0xFFu << m_ChannelShifts[3]) };
+				for (size_t pixelIdx{ 0 }; pixelIdx < layerPixels.size(); ++pixelIdx)
+				{
+					const uint32_t alpha{ (alphaPixels[pixelIdx] >> m_ChannelShifts[0]) & 0xFF };
+					layerPixels[pixelIdx] = (layerPixels[pixelIdx] & colorMask) | (alpha << m_ChannelShifts[3]);
+				}
+			}
+
+			for (size_t pixelIdx{ 0 }; pixelIdx < layerPixels.size(); ++pixelIdx)
+			{
+				pixels[pixelIdx * nrLayers + layerIdx] = layerPixels[pixelIdx];
+			}
+		}
+		return new Texture(pixels, width, height, nrLayers);
 	}
 
-	ColorRGB Texture::Sample(const Vector2& uv) const
+	void Texture::Sample(const Vector2& uv, const Vector2& uvDdx, const Vector2& uvDdy, Texel* pTexels) const
 	{
-		Uint8 r, g, b;
+		// Level of detail is log2 of the longest pixel step in texels, the square root is folded into the log
+		const float width{ static_cast<float>(m_MipLevels.front().width) };
+		const float height{ static_cast<float>(m_MipLevels.front().height) };
+		const float texelDdxX{ uvDdx.x * width };
+		const float texelDdxY{ uvDdx.y * height };
+		const float texelDdyX{ uvDdy.x * width };
+		const float texelDdyY{ uvDdy.y * height };
+		const float maxSqrStep{ std::max(texelDdxX * texelDdxX + texelDdxY * texelDdxY, texelDdyX * texelDdyX + texelDdyY * texelDdyY) };
+		// Magnified (or no derivatives at all), the most detailed level is as good as it gets
+		if (!(maxSqrStep > 1.f))
+		{
+			SampleBilinear(m_MipLevels.front(), uv, pTexels);
+			return;
+		}
 
-		const size_t x{ static_cast<size_t>(uv.x * m_pSurface->w) };
-		const size_t y{ static_cast<size_t>(uv.y * m_pSurface->h) };
+		// log2 from the float bits, the exponent is the integer part and the mantissa is close enough to the fraction
+		const uint32_t bits{ std::bit_cast<uint32_t>(maxSqrStep) };
+		const float log2SqrStep{ static_cast<float>(static_cast<int>(bits >> 23) - 127) + static_cast<float>(bits & 0x7FFFFF) * (1.f / (1 << 23)) };
+		const float lod{ std::min(0.5f * log2SqrStep, static_cast<float>(m_MipLevels.size() - 1)) };
+		const int levelIdx{ static_cast<int>(lod) };
+		const float levelWeight{ lod - levelIdx };
+		SampleBilinear(m_MipLevels[levelIdx], uv, pTexels);
+		if (levelWeight == 0.f)
+			return;
 
-		const Uint32 pixel{m_pSurfacePixels[x + y * m_pSurface->w]};
+		Texel nextTexels[m_MaxNrLayers];
+		SampleBilinear(m_MipLevels[levelIdx + 1], uv, nextTexels);
+		for (int layerIdx{ 0 }; layerIdx < m_NrLayers; ++layerIdx)
+		{
+			pTexels[layerIdx] = { ColorRGB::Lerp(pTexels[layerIdx].color, nextTexels[layerIdx].color, levelWeight), Lerpf(pTexels[layerIdx].alpha, nextTexels[layerIdx].alpha, levelWeight) };
+		}
+	}
+
+	void Texture::SampleBilinear(const MipLevel& level, const Vector2& uv, Texel* pTexels) const
+	{
+		// Texel centers are at half integers, the edges are clamped
+		// In 8 bit fixed point, so the integer part and the weight are a shift and a mask
+		const int fixedX{ static_cast<int>(uv.x * (level.width * 256.f)) - 128 };
+		const int fixedY{ static_cast<int>(uv.y * (level.height * 256.f)) - 128 };
+		const int weightX{ fixedX & 0xFF };
+		const int weightY{ fixedY & 0xFF };
+
+		const int x0{ std::clamp(fixedX >> 8, 0, level.width - 1) };
+		const int x1{ std::clamp((fixedX >> 8) + 1, 0, level.width - 1) };
+		const int y0{ std::clamp(fixedY >> 8, 0, level.height - 1) };
+		const int y1{ std::clamp((fixedY >> 8) + 1, 0, level.height - 1) };
+		const uint32_t offsetX0{ level.pOffsetsX[x0] };
+		const uint32_t offsetX1{ level.pOffsetsX[x1] };
+		const uint32_t offsetY0{ level.pOffsetsY[y0] };
+		const uint32_t offsetY1{ level.pOffsetsY[y1] };
 
-		SDL_GetRGB(pixel, m_pSurface->format, &r, &g, &b);
+		// The records of the four pixels, every layer of a pixel is right after the one before
+		const uint32_t* const pRecords[4]{ level.pPixels + offsetX0 + offsetY0, level.pPixels + offsetX1 + offsetY0, level.pPixels + offsetX0 + offsetY1, level.pPixels + offsetX1 + offsetY1 };
+		// They add up to 1 << 16
+		const int weights[4]{ (256 - weightX) * (256 - weightY), weightX * (256 - weightY), (256 - weightX) * weightY, weightX * weightY };
 
-		const constexpr float invClampVal{ 1 / 255.f };
+		const constexpr float invClampVal{ 1 / (255.f * 65536.f) };
 
-		return { r * invClampVal,g * invClampVal,b * invClampVal };
+		for (int layerIdx{ 0 }; layerIdx < m_NrLayers; ++layerIdx)
+		{
+			// The layout is known at compile time, so every channel is a constant shift and mask
+			int channels[4]{};
+			for (int pixelIdx{ 0 }; pixelIdx < 4; ++pixelIdx)
+			{
+				const uint32_t pixel{ pRecords[pixelIdx][layerIdx] };
+				for (int channelIdx{ 0 }; channelIdx < 4; ++channelIdx)
+				{
+					channels[channelIdx] += weights[pixelIdx] * static_cast<int>((pixel >> m_ChannelShifts[channelIdx]) & 0xFF);
+				}
+			}
+			pTexels[layerIdx] = { { channels[0] * invClampVal,channels[1] * invClampVal,channels[2] * invClampVal }, channels[3] * invClampVal };
+		}
 	}
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #pragma once
-#include <SDL_surface.h>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "ColorRGB.h"
 
 namespace dae
@@ -10,15 +11,56 @@ namespace dae
 	class Texture
 	{
 	public:
-		~Texture();
+		// Filtered channels, 0 to 1
+		struct Texel
+		{
+			ColorRGB color{};
+			float alpha{};
+		};
 
-		static Texture* LoadFromFile(const std::string& path);
-		ColorRGB Sample(const Vector2& uv) const;
+		// The images of one layer, alphaPath is optional and its red channel replaces the alpha of the color image
+		// That packs a single channel map (gloss) with another map
+		struct LayerFiles
+		{
+			std::string colorPath{};
+			std::string alphaPath{};
+		};
+
+		static constexpr int m_MaxNrLayers{ 4 };
+
+		// The layers of a pixel are stored next to each other, so one address lookup covers every map of a material
+		// Every image needs to be the same size
+		static Texture* LoadLayers(const std::vector<LayerFiles>& layers);
+		// Trilinear, the level of detail follows from the change of uv over one pixel to the right and one pixel down
+		// Every layer at once, pTexels gets GetNrLayers() texels
+		void Sample(const Vector2& uv, const Vector2& uvDdx, const Vector2& uvDdy, Texel* pTexels) const;
+		int GetNrLayers() const { return m_NrLayers; }
 
 	private:
-		Texture(SDL_Surface* pSurface);
+		// Level 0 is the image, every next level is a box filtered copy at half the size of the one before
+		// The pixels are in Z-order (Morton), so the pixels around a pixel are mostly in the same cache line whatever the direction
+		// The layers of pixel (x, y) start at pPixels[pOffsetsX[x] + pOffsetsY[y]]
+		struct MipLevel
+		{
+			int width{};
+			int height{};
+			const uint32_t* pPixels{ nullptr };
+			const uint32_t* pOffsetsX{ nullptr };
+			const uint32_t* pOffsetsY{ nullptr };
+		};
+
+		// Row-major RGBA8 pixels with the layers of a pixel next to each other, see m_ChannelShifts
+		Texture(const std::vector<uint32_t>& pixels, int width, int height, int nrLayers);
+
+		void SampleBilinear(const MipLevel& level, const Vector2& uv, Texel* pTexels) const;
 
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		// Every image is converted to RGBA8 at load, r in the lowest byte and a in the highest, whatever format the file had
+		static constexpr int m_ChannelShifts[4]{ 0, 8, 16, 24 };
+		int m_NrLayers{ 1 };
+		std::vector<MipLevel> m_MipLevels{};
+		// The pixels of every level
+		std::vector<uint32_t> m_Pixels{};
+		// pOffsetsX and pOffsetsY of every level
+		std::vector<uint32_t> m_Offsets{};
 	};
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace dae;
+
+ThreadPool::ThreadPool(unsigned int nrThreads)
+{
+	if (nrThreads == 0)
+	{
+		nrThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	// The thread calling ParallelFor counts as one of the threads
+	m_Workers.reserve(nrThreads - 1);
+	for (unsigned int i{ 1 }; i < nrThreads; ++i)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::RunParallelFor(int count, JobFunction pJobFunction, const void* pJob)
+{
+	if (count <= 0) return;
+
+	// Not worth waking anyone up
+	if (m_Workers.empty() || count == 1)
+	{
+		for (int idx{ 0 }; idx < count; ++idx)
+		{
+			pJobFunction(pJob, idx);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_pJobFunction = pJobFunction;
+		m_pJob = pJob;
+		m_JobCount = count;
+		m_NextJobIdx = 0;
+		m_BusyWorkers = static_cast<unsigned int>(m_Workers.size());
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	RunJobs();
+
+	std::unique_lock<std::mutex> lock{ m_Mutex };
+	m_DoneCondition.wait(lock, [this]() { return m_BusyWorkers == 0; });
+	m_pJobFunction = nullptr;
+	m_pJob = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t lastGeneration{};
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_WakeCondition.wait(lock, [&]() { return m_IsStopping || m_Generation != lastGeneration; });
+			if (m_IsStopping) return;
+			lastGeneration = m_Generation;
+		}
+
+		RunJobs();
+
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			--m_BusyWorkers;
+			if (m_BusyWorkers == 0) m_DoneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::RunJobs()
+{
+	// Jobs are handed out one at a time so uneven jobs still balance out
+	for (int idx{ m_NextJobIdx++ }; idx < m_JobCount; idx = m_NextJobIdx++)
+	{
+		m_pJobFunction(m_pJob, idx);
+	}
+}
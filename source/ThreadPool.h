@@ -0,0 +1,57 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		// nrThreads includes the calling thread, 0 means one per hardware thread
+		ThreadPool(unsigned int nrThreads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		// Calls job(idx) for every idx in [0, count).
+		// The calling thread helps out and only returns once every job is done.
+		// The job is only referenced (no std::function), so this never allocates
+		template<typename Job>
+		void ParallelFor(int count, const Job& job)
+		{
+			RunParallelFor(count, [](const void* pJob, int idx) { (*static_cast<const Job*>(pJob))(idx); }, &job);
+		}
+
+		unsigned int GetNrThreads() const { return static_cast<unsigned int>(m_Workers.size()) + 1; }
+
+	private:
+		using JobFunction = void (*)(const void* pJob, int idx);
+
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		JobFunction m_pJobFunction{ nullptr };
+		const void* m_pJob{ nullptr };
+		int m_JobCount{};
+		std::atomic<int> m_NextJobIdx{};
+		unsigned int m_BusyWorkers{};
+		uint64_t m_Generation{};
+		bool m_IsStopping{ false };
+
+		void RunParallelFor(int count, JobFunction pJobFunction, const void* pJob);
+		void WorkerLoop();
+		void RunJobs();
+	};
+}
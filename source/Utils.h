@@ -1,8 +1,13 @@
 #pragma once
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "ThreadPool.h"
 
 //#define DISABLE_OBJ
 
@@ -11,9 +16,10 @@ namespace dae
 	namespace Utils
 	{
 		//Just parses vertices and indices
+		//Big files are parsed on multiple threads when a thread pool is passed
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true)
+		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true, ThreadPool* pThreadPool = nullptr)
 		{
 #ifdef DISABLE_OBJ
 
@@ -23,149 +29,357 @@ namespace dae
 
 #else
 
-			std::ifstream file(filename);
+			// Read the whole file in one go, parsing from memory is a lot faster than going through the stream
+			std::ifstream file(filename, std::ios::binary | std::ios::ate);
 			if (!file)
 				return false;
+			std::string buffer(static_cast<size_t>(file.tellg()), '\0');
+			file.seekg(0);
+			if (!file.read(buffer.data(), buffer.size()))
+				return false;
 
-			std::vector<Vector3> positions{};
-			std::vector<Vector3> normals{};
-			std::vector<Vector2> UVs{};
+			const char* const pFileBegin{ buffer.data() };
+			const char* const pFileEnd{ pFileBegin + buffer.size() };
+			const auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+			const auto skipSpaces = [&](const char* p)
+			{
+				while (p < pFileEnd && isSpace(*p)) ++p;
+				return p;
+			};
+			const auto skipLine = [&](const char* p)
+			{
+				p = static_cast<const char*>(std::memchr(p, '\n', pFileEnd - p));
+				return p ? p + 1 : pFileEnd;
+			};
+			// The command of the line starting at p, p is moved past it
+			enum class Command { Other, Position, TexCoord, Normal, Face };
+			const auto readCommand = [&](const char*& p)
+			{
+				p = skipSpaces(p);
+				if (pFileEnd - p < 3)
+					return Command::Other;
 
-			vertices.clear();
-			indices.clear();
+				const auto isCommand = [&](const char* command, size_t length)
+				{
+					if (std::memcmp(p, command, length) != 0 || !isSpace(p[length]))
+						return false;
+					p += length;
+					return true;
+				};
+				if (p[0] == 'f' && isCommand("f", 1)) return Command::Face;
+				if (p[0] != 'v') return Command::Other;
+				if (isCommand("v", 1)) return Command::Position;
+				if (isCommand("vt", 2)) return Command::TexCoord;
+				if (isCommand("vn", 2)) return Command::Normal;
+				return Command::Other;
+			};
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			// Decimals with at most 7 digits are exact as floats, as are the powers of 10 up to 10^10,
+			// so one division already rounds them correctly (Clinger's fast path). The rest goes through from_chars
+			const auto readFloat = [&](const char*& p, float& value)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
+				constexpr float powersOf10[]{ 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
 
-					positions.emplace_back(x, y, z);
-				}
-				else if (sCommand == "vt")
+				p = skipSpaces(p);
+				const bool isNegative{ p < pFileEnd && *p == '-' };
+				const char* pDigit{ p + isNegative };
+				uint32_t mantissa{};
+				int nrDigits{}, nrDecimals{};
+				bool hasPoint{ false };
+				for (; pDigit < pFileEnd; ++pDigit)
 				{
-					// Vertex TexCoord
-					float u, v;
-					file >> u >> v;
-					UVs.emplace_back(u, 1 - v);
+					if (*pDigit >= '0' && *pDigit <= '9')
+					{
+						mantissa = mantissa * 10 + (*pDigit - '0');
+						++nrDigits;
+						nrDecimals += hasPoint;
+					}
+					else if (*pDigit == '.' && !hasPoint)
+						hasPoint = true;
+					else
+						break;
 				}
-				else if (sCommand == "vn")
+				if (nrDigits > 0 && nrDigits <= 7 && (pDigit == pFileEnd || (*pDigit != 'e' && *pDigit != 'E')))
 				{
-					// Vertex Normal
-					float x, y, z;
-					file >> x >> y >> z;
-
-					normals.emplace_back(x, y, z);
+					const float absValue{ static_cast<float>(mantissa) / powersOf10[nrDecimals] };
+					value = isNegative ? -absValue : absValue;
+					p = pDigit;
+					return true;
 				}
-				else if (sCommand == "f")
+
+				const auto [pNext, error] { std::from_chars(p, pFileEnd, value) };
+				p = pNext;
+				return error == std::errc{};
+			};
+			// OBJ indices are 1-based, negative ones count back from the last element read so far
+			const auto readIndex = [&](const char*& p, size_t nrElements, uint32_t& index)
+			{
+				int64_t value{};
+				const auto [pNext, error] { std::from_chars(p, pFileEnd, value) };
+				p = pNext;
+				if (value < 0) value += int64_t(nrElements) + 1;
+				index = uint32_t(value);
+				return error == std::errc{} && value > 0 && size_t(value) <= nrElements;
+			};
+
+			// The OBJ indices of a face corner, 0 means the corner doesn't have that attribute
+			struct ObjCorner
+			{
+				uint32_t iPosition, iTexCoord, iNormal;
+				bool operator==(const ObjCorner& other) const = default;
+			};
+
+			// Big files are split at line boundaries and the pieces are parsed on the thread pool.
+			// Each one is counted first, so it knows where its elements go in the shared arrays
+			// and what the indices in its faces refer to
+			struct Chunk
+			{
+				const char* pBegin{}, * pEnd{};
+				size_t nrPositions{}, nrUVs{}, nrNormals{}, nrFaces{};
+				size_t firstPosition{}, firstUV{}, firstNormal{};
+				// The corners of all faces back to back, in file order
+				std::vector<ObjCorner> corners{};
+				std::vector<uint32_t> faceSizes{};
+				bool isValid{ true };
+			};
+			constexpr size_t minChunkSize{ 1 << 20 };
+			const size_t maxNrChunks{ pThreadPool ? pThreadPool->GetNrThreads() * size_t{ 4 } : 1 };
+			std::vector<Chunk> chunks(std::clamp(buffer.size() / minChunkSize, size_t{ 1 }, maxNrChunks));
+			for (size_t chunkIdx{ 0 }; chunkIdx < chunks.size(); ++chunkIdx)
+			{
+				Chunk& chunk{ chunks[chunkIdx] };
+				chunk.pBegin = chunkIdx == 0 ? pFileBegin : chunks[chunkIdx - 1].pEnd;
+				chunk.pEnd = chunkIdx + 1 == chunks.size() ? pFileEnd
+					: skipLine(std::max(chunk.pBegin, pFileBegin + buffer.size() * (chunkIdx + 1) / chunks.size()));
+			}
+			const auto forEachChunk = [&](const auto& job)
+			{
+				if (pThreadPool)
+					pThreadPool->ParallelFor(static_cast<int>(chunks.size()), job);
+				else
+					job(0);
+			};
+
+			// Counting pass, so nothing has to grow while parsing
+			forEachChunk([&](int chunkIdx)
+			{
+				Chunk& chunk{ chunks[chunkIdx] };
+				for (const char* p{ chunk.pBegin }; p < chunk.pEnd; p = skipLine(p))
 				{
-					//if a face is read:
-					//construct the 3 vertices, add them to the vertex array
-					//add three indices to the index array
-					//add the material index as attibute to the attribute array
-					//
-					// Faces or triangles
-					Vertex vertex{};
-					size_t iPosition, iTexCoord, iNormal;
-
-					uint32_t tempIndices[3];
-					for (size_t iFace = 0; iFace < 3; iFace++)
+					switch (readCommand(p))
 					{
-						// OBJ format uses 1-based arrays
-						file >> iPosition;
-						vertex.position = positions[iPosition - 1];
+					case Command::Position: ++chunk.nrPositions; break;
+					case Command::TexCoord: ++chunk.nrUVs; break;
+					case Command::Normal: ++chunk.nrNormals; break;
+					case Command::Face: ++chunk.nrFaces; break;
+					default: break;
+					}
+				}
+			});
 
-						if ('/' == file.peek())//is next in buffer ==  '/' ?
-						{
-							file.ignore();//read and ignore one element ('/')
+			size_t nrPositions{}, nrUVs{}, nrNormals{}, nrFaces{};
+			for (Chunk& chunk : chunks)
+			{
+				chunk.firstPosition = nrPositions;
+				chunk.firstUV = nrUVs;
+				chunk.firstNormal = nrNormals;
+				nrPositions += chunk.nrPositions;
+				nrUVs += chunk.nrUVs;
+				nrNormals += chunk.nrNormals;
+				nrFaces += chunk.nrFaces;
+			}
+			std::vector<Vector3> positions(nrPositions);
+			std::vector<Vector3> normals(nrNormals);
+			std::vector<Vector2> UVs(nrUVs);
 
-							if ('/' != file.peek())
-							{
-								// Optional texture coordinate
-								file >> iTexCoord;
-								vertex.uv = UVs[iTexCoord - 1];
-							}
+			forEachChunk([&](int chunkIdx)
+			{
+				Chunk& chunk{ chunks[chunkIdx] };
+				// Faces are counted as triangles, polygons just make the corners grow a bit
+				chunk.corners.reserve(chunk.nrFaces * 3);
+				chunk.faceSizes.reserve(chunk.nrFaces);
 
-							if ('/' == file.peek())
-							{
-								file.ignore();
+				// Elements read so far, faces can only use those
+				size_t positionIdx{ chunk.firstPosition }, UVIdx{ chunk.firstUV }, normalIdx{ chunk.firstNormal };
+				const auto readCorner = [&](const char*& p, ObjCorner& corner)
+				{
+					if (!readIndex(p, positionIdx, corner.iPosition))
+						return false;
+					if (p < pFileEnd && *p == '/')
+					{
+						// Optional texture coordinate
+						if (++p < pFileEnd && *p != '/' && !readIndex(p, UVIdx, corner.iTexCoord))
+							return false;
+						// Optional vertex normal
+						if (p < pFileEnd && *p == '/' && !readIndex(++p, normalIdx, corner.iNormal))
+							return false;
+					}
+					return true;
+				};
 
-								// Optional vertex normal
-								file >> iNormal;
-								vertex.normal = normals[iNormal - 1];
-							}
+				for (const char* p{ chunk.pBegin }; p < chunk.pEnd; p = skipLine(p))
+				{
+					switch (readCommand(p))
+					{
+					case Command::Position:
+					{
+						float x, y, z;
+						if (!readFloat(p, x) || !readFloat(p, y) || !readFloat(p, z))
+						{
+							chunk.isValid = false;
+							return;
 						}
-
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
-						//indices.push_back(uint32_t(vertices.size()) - 1);
+						positions[positionIdx++] = Vector3{ x, y, z };
+						break;
 					}
-
-					indices.push_back(tempIndices[0]);
-					if (flipAxisAndWinding) 
+					case Command::TexCoord:
 					{
-						indices.push_back(tempIndices[2]);
-						indices.push_back(tempIndices[1]);
+						float u, v;
+						if (!readFloat(p, u) || !readFloat(p, v))
+						{
+							chunk.isValid = false;
+							return;
+						}
+						UVs[UVIdx++] = Vector2{ u, 1 - v };
+						break;
 					}
-					else
+					case Command::Normal:
 					{
-						indices.push_back(tempIndices[1]);
-						indices.push_back(tempIndices[2]);
+						float x, y, z;
+						if (!readFloat(p, x) || !readFloat(p, y) || !readFloat(p, z))
+						{
+							chunk.isValid = false;
+							return;
+						}
+						normals[normalIdx++] = Vector3{ x, y, z };
+						break;
+					}
+					case Command::Face:
+					{
+						uint32_t faceSize{};
+						// A comment can follow the last corner
+						for (p = skipSpaces(p); p < pFileEnd && *p != '\n' && *p != '#'; p = skipSpaces(p))
+						{
+							ObjCorner corner{};
+							if (!readCorner(p, corner))
+							{
+								chunk.isValid = false;
+								return;
+							}
+							chunk.corners.push_back(corner);
+							++faceSize;
+						}
+						chunk.faceSizes.push_back(faceSize);
+						break;
+					}
+					default: break;
 					}
 				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
-			}
+			});
 
-			//Cheap Tangent Calculations
-			for (uint32_t i = 0; i < indices.size(); i += 3)
-			{
-				uint32_t index0 = indices[i];
-				uint32_t index1 = indices[size_t(i) + 1];
-				uint32_t index2 = indices[size_t(i) + 2];
-
-				const Vector3& p0 = vertices[index0].position;
-				const Vector3& p1 = vertices[index1].position;
-				const Vector3& p2 = vertices[index2].position;
-				const Vector2& uv0 = vertices[index0].uv;
-				const Vector2& uv1 = vertices[index1].uv;
-				const Vector2& uv2 = vertices[index2].uv;
-
-				const Vector3 edge0 = p1 - p0;
-				const Vector3 edge1 = p2 - p0;
-				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
-				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
-
-				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
-				vertices[index0].tangent += tangent;
-				vertices[index1].tangent += tangent;
-				vertices[index2].tangent += tangent;
+			size_t nrTriangles{};
+			for (const Chunk& chunk : chunks)
+			{
+				if (!chunk.isValid)
+					return false;
+				for (uint32_t faceSize : chunk.faceSizes)
+				{
+					if (faceSize >= 3) nrTriangles += faceSize - 2;
+				}
 			}
 
-			//Fix the tangents per vertex now because we accumulated
-			for (auto& v : vertices)
+			vertices.clear();
+			indices.clear();
+			vertices.reserve(std::max({ nrPositions, nrUVs, nrNormals }));
+			indices.reserve(nrTriangles * 3);
+
+			// Face corners with the same position, uv and normal share one vertex (welding)
+			// They're looked up in an open addressing hash table that is kept at most half full
+			// This stays on one thread so the vertices keep the order they're first used in
+			const auto hashCorner = [](const ObjCorner& corner)
+			{
+				const size_t hash{ (corner.iPosition * 0x9E3779B97F4A7C15ull) ^ (corner.iTexCoord * 0xC2B2AE3D27D4EB4Full) ^ (corner.iNormal * 0x165667B19E3779F9ull) };
+				return hash ^ (hash >> 32);
+			};
+			constexpr uint32_t noVertex{ UINT32_MAX };
+			std::vector<uint32_t> vertexTable(std::bit_ceil(std::max(nrFaces * 6, size_t{ 16 })), noVertex);
+			size_t vertexTableMask{ vertexTable.size() - 1 };
+			std::vector<ObjCorner> vertexCorners{};
+			vertexCorners.reserve(vertices.capacity());
+			const auto growVertexTable = [&]()
+			{
+				vertexTable.assign(vertexTable.size() * 2, noVertex);
+				vertexTableMask = vertexTable.size() - 1;
+				for (uint32_t vertexIdx{ 0 }; vertexIdx < vertexCorners.size(); ++vertexIdx)
+				{
+					size_t slot{ hashCorner(vertexCorners[vertexIdx]) & vertexTableMask };
+					while (vertexTable[slot] != noVertex) slot = (slot + 1) & vertexTableMask;
+					vertexTable[slot] = vertexIdx;
+				}
+			};
+			const auto getVertex = [&](const ObjCorner& corner)
+			{
+				// Only add the vertex if no earlier corner used the same one
+				size_t slot{ hashCorner(corner) & vertexTableMask };
+				for (; vertexTable[slot] != noVertex; slot = (slot + 1) & vertexTableMask)
+				{
+					if (vertexCorners[vertexTable[slot]] == corner)
+						return vertexTable[slot];
+				}
+
+				Vertex vertex{};
+				vertex.position = positions[corner.iPosition - 1];
+				if (corner.iTexCoord) vertex.uv = UVs[corner.iTexCoord - 1];
+				if (corner.iNormal) vertex.normal = normals[corner.iNormal - 1];
+				const uint32_t vertexIdx{ uint32_t(vertices.size()) };
+				vertexTable[slot] = vertexIdx;
+				vertices.push_back(vertex);
+				vertexCorners.push_back(corner);
+				if (vertexCorners.size() * 2 > vertexTable.size())
+					growVertexTable();
+				return vertexIdx;
+			};
+
+			for (const Chunk& chunk : chunks)
 			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+				const ObjCorner* pCorner{ chunk.corners.data() };
+				for (uint32_t faceSize : chunk.faceSizes)
+				{
+					// Quads and other polygons are split into a fan around their first corner
+					uint32_t firstVertex{}, previousVertex{};
+					for (uint32_t cornerIdx{ 0 }; cornerIdx < faceSize; ++cornerIdx)
+					{
+						const uint32_t vertex{ getVertex(*pCorner++) };
+						if (cornerIdx == 0)
+						{
+							firstVertex = vertex;
+						}
+						else if (cornerIdx >= 2)
+						{
+							indices.push_back(firstVertex);
+							if (flipAxisAndWinding)
+							{
+								indices.push_back(vertex);
+								indices.push_back(previousVertex);
+							}
+							else
+							{
+								indices.push_back(previousVertex);
+								indices.push_back(vertex);
+							}
+						}
+						previousVertex = vertex;
+					}
+				}
+			}
 
-				if(flipAxisAndWinding)
+			if (flipAxisAndWinding)
+			{
+				for (auto& v : vertices)
 				{
 					v.position.z *= -1.f;
 					v.normal.z *= -1.f;
-					v.tangent.z *= -1.f;
 				}
-
 			}
 
 			return true;
@@ -207,6 +421,7 @@ namespace dae
 
 		/**
 		 * \brief todo
+		 * \tparam isFast FastPow instead of powf, at most 2e-5 * exp off relatively
 		 * \param ks Specular Reflection Coefficient
 		 * \param exp Phong Exponent
 		 * \param l Incoming (incident) Light Direction
@@ -214,6 +429,7 @@ namespace dae
 		 * \param n Normal of the Surface
 		 * \return Phong Specular Color
 		 */
+		template<bool isFast = false>
 		inline ColorRGB Phong(float ks, float exp, const Vector3& l, const Vector3& v, const Vector3& n)
 		{
 			Vector3 reflect = Vector3::Reflect(l, n);
@@ -221,7 +437,10 @@ namespace dae
 			float PSR{};
 			if (alfa > 0)
 			{
-				PSR = ks * (powf(alfa, exp));
+				if constexpr (isFast)
+					PSR = ks * FastPow(alfa, exp);
+				else
+					PSR = ks * (powf(alfa, exp));
 			}
 			return { PSR,PSR,PSR };
 		}
@@ -8,6 +8,7 @@
 #include <iostream>
 
 //Project includes
+#include "AllocationCounter.h"
 #include "Timer.h"
 #include "Renderer.h"
 
@@ -47,6 +48,8 @@ int main(int argc, char* args[])
 	//Start loop
 	pTimer->Start();
 	float printTimer = 0.f;
+	int printFrameCount = 0;
+	uint64_t printAllocationCount = AllocationCounter::GetCount();
 	bool isLooping = true;
 	bool takeScreenshot = false;
 	while (isLooping)
@@ -76,10 +79,17 @@ int main(int argc, char* args[])
 		//--------- Timer ---------
 		pTimer->Update();
 		printTimer += pTimer->GetElapsed();
+		++printFrameCount;
 		if (printTimer >= 1.f)
 		{
+			//Should be 0 once everything is warmed up
+			const uint64_t allocationCount = AllocationCounter::GetCount();
+			const float allocationsPerFrame = static_cast<float>(allocationCount - printAllocationCount) / printFrameCount;
+
 			printTimer = 0.f;
-			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			printFrameCount = 0;
+			printAllocationCount = allocationCount;
+			std::cout << "dFPS: " << pTimer->GetdFPS() << " (" << allocationsPerFrame << " allocations per frame)" << std::endl;
 		}
 
 		//Save screenshot after full render